@@ -27,52 +27,194 @@
 #ifndef LLVM_EXECUTIONENGINE_ORC_KALEIDOSCOPEJIT_H
 #define LLVM_EXECUTIONENGINE_ORC_KALEIDOSCOPEJIT_H
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/JITLink/JITLinkMemoryManager.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/EPCEHFrameRegistrar.h"
 #include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
 #include "llvm/ExecutionEngine/Orc/ExecutorProcessControl.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
 #include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
+#include "llvm/ExecutionEngine/Orc/MapperJITLinkMemoryManager.h"
+#include "llvm/ExecutionEngine/Orc/MemoryMapper.h"
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/Orc/Shared/ExecutorSymbolDef.h"
+#include "llvm/ExecutionEngine/Orc/TaskDispatch.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/TargetParser/Host.h"
+#include "llvm/TargetParser/SubtargetFeature.h"
+#include "llvm/TargetParser/Triple.h"
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <string>
 
 namespace llvm {
 namespace orc {
 
+// How to set up a KaleidoscopeJIT. The defaults compile for the host CPU on
+// the thread that looks a symbol up, without an object cache.
+struct KaleidoscopeJITConfig {
+  // The CPU to compile for; empty or "native" for the host's, with all of
+  // the features it has. Features turns some on or off on top of those, as
+  // in "+avx2,-fma".
+  std::string CPU;
+  std::string Features;
+  // If not 0, materialization (optimizing, compiling, linking) runs on a
+  // pool of that many threads, see FixedThreadPoolTaskDispatcher.
+  unsigned CompileThreads = 0;
+  // If set, gives the ObjectCache of each compile layer, from the target
+  // and the codegen level it compiles for. The caches must outlive the JIT.
+  std::function<ObjectCache *(const JITTargetMachineBuilder &,
+                              CodeGenOptLevel)>
+      CacheFor;
+  // If not 0, objects are linked by JITLink into slabs of this many bytes,
+  // each reserved once and reused as modules are removed, instead of by
+  // RuntimeDyld into fresh pages mapped for every object.
+  size_t JITLinkSlabSize = 0;
+  // If set, objects are linked by JITLink into the memory manager this
+  // makes, whatever JITLinkSlabSize is.
+  std::function<std::unique_ptr<jitlink::JITLinkMemoryManager>()>
+      JITLinkMemory;
+};
+
+// Runs the materialization tasks of a session on a pool of a fixed number
+// of threads. DynamicThreadPoolTaskDispatcher starts a thread per task, and
+// takes no limit before LLVM 19, where it only caps them. Any other task
+// (a lookup's continuation, say) may wait for a materialization, so it gets
+// a thread of its own as before, never one of the pool's.
+class FixedThreadPoolTaskDispatcher : public TaskDispatcher {
+public:
+  explicit FixedThreadPoolTaskDispatcher(unsigned Threads)
+      : Pool(hardware_concurrency(Threads)) {}
+
+  void dispatch(std::unique_ptr<Task> T) override {
+    if (!isa<MaterializationTask>(*T))
+      return Others.dispatch(std::move(T));
+    // the pool takes copyable functions only
+    std::shared_ptr<Task> Shared(std::move(T));
+    Pool.async([Shared] { Shared->run(); });
+  }
+
+  void shutdown() override {
+    Pool.wait();
+    Others.shutdown();
+  }
+
+private:
+  ThreadPool Pool;
+  DynamicThreadPoolTaskDispatcher Others;
+};
+
 class KaleidoscopeJIT {
 private:
   std::unique_ptr<ExecutionSession> ES;
 
+  Triple TT;
+  // What the compile layers make their target machines from.
+  JITTargetMachineBuilder TMBuilder;
   DataLayout DL;
   MangleAndInterner Mangle;
 
-  RTDyldObjectLinkingLayer ObjectLayer;
+  std::unique_ptr<ObjectLayer> ObjLayer;
+  // No codegen optimization, so FastISel: for code that has to be ready
+  // soon rather than run fast (tier 0 of TieredJIT, one-shot expressions).
+  IRCompileLayer FastCompileLayer;
   IRCompileLayer CompileLayer;
+  // Runs the IR optimizer, if one is set, right before CompileLayer; so
+  // a lazily compiled function is also optimized only on its first call.
+  IRTransformLayer OptimizeLayer;
 
   JITDylib &MainJD;
 
+  // Only after enableLazyCompilation().
+  std::unique_ptr<LazyCallThroughManager> LCTMgr;
+  std::unique_ptr<CompileOnDemandLayer> CODLayer;
+
+  static std::unique_ptr<IRCompileLayer::IRCompiler>
+  makeCompiler(const JITTargetMachineBuilder &JTMB, CodeGenOptLevel Level,
+               const KaleidoscopeJITConfig &Config) {
+    JITTargetMachineBuilder LevelJTMB(JTMB);
+    LevelJTMB.setCodeGenOptLevel(Level);
+    ObjectCache *Cache =
+        Config.CacheFor ? Config.CacheFor(LevelJTMB, Level) : nullptr;
+    return std::make_unique<ConcurrentIRCompiler>(std::move(LevelJTMB),
+                                                  Cache);
+  }
+
+  // RuntimeDyld with a SectionMemoryManager per object, or JITLink with one
+  // memory manager carving every object out of the same slabs.
+  static Expected<std::unique_ptr<ObjectLayer>>
+  createObjectLayer(ExecutionSession &ES, const Triple &TT,
+                    const KaleidoscopeJITConfig &Config) {
+    if (!Config.JITLinkSlabSize && !Config.JITLinkMemory) {
+      auto Layer = std::make_unique<RTDyldObjectLinkingLayer>(
+          ES, []() { return std::make_unique<SectionMemoryManager>(); });
+      if (TT.isOSBinFormatCOFF()) {
+        Layer->setOverrideObjectFlagsWithResponsibilityFlags(true);
+        Layer->setAutoClaimResponsibilityForObjectSymbols(true);
+      }
+      return std::move(Layer);
+    }
+
+    std::unique_ptr<jitlink::JITLinkMemoryManager> MemMgr;
+    if (Config.JITLinkMemory) {
+      MemMgr = Config.JITLinkMemory();
+    } else {
+      auto Slabs =
+          MapperJITLinkMemoryManager::CreateWithMapper<InProcessMemoryMapper>(
+              Config.JITLinkSlabSize);
+      if (!Slabs)
+        return Slabs.takeError();
+      MemMgr = std::move(*Slabs);
+    }
+    auto Layer = std::make_unique<ObjectLinkingLayer>(ES, std::move(MemMgr));
+    // RuntimeDyld registers the unwind info of what it links, so do the same
+    auto EHFrames = EPCEHFrameRegistrar::Create(ES);
+    if (!EHFrames)
+      return EHFrames.takeError();
+    Layer->addPlugin(std::make_unique<EHFrameRegistrationPlugin>(
+        ES, std::move(*EHFrames)));
+    return std::move(Layer);
+  }
+
+  static void handleLazyCallThroughError() {
+    errs() << "LazyCallThrough error: Could not find function body";
+    exit(1);
+  }
+
 public:
   KaleidoscopeJIT(std::unique_ptr<ExecutionSession> ES,
-                  JITTargetMachineBuilder JTMB, DataLayout DL)
-      : ES(std::move(ES)), DL(std::move(DL)), Mangle(*this->ES, this->DL),
-        ObjectLayer(*this->ES,
-                    []() { return std::make_unique<SectionMemoryManager>(); }),
-        CompileLayer(*this->ES, ObjectLayer,
-                     std::make_unique<ConcurrentIRCompiler>(std::move(JTMB))),
+                  JITTargetMachineBuilder JTMB, DataLayout DL,
+                  std::unique_ptr<ObjectLayer> ObjLayer,
+                  const KaleidoscopeJITConfig &Config = {})
+      : ES(std::move(ES)), TT(JTMB.getTargetTriple()), TMBuilder(JTMB),
+        DL(std::move(DL)),
+        Mangle(*this->ES, this->DL), ObjLayer(std::move(ObjLayer)),
+        FastCompileLayer(*this->ES, *this->ObjLayer,
+                         makeCompiler(JTMB, CodeGenOptLevel::None, Config)),
+        CompileLayer(*this->ES, *this->ObjLayer,
+                     makeCompiler(JTMB, CodeGenOptLevel::Default, Config)),
+        OptimizeLayer(*this->ES, CompileLayer),
         MainJD(this->ES->createBareJITDylib("<main>")) {
     MainJD.addGenerator(
         cantFail(DynamicLibrarySearchGenerator::GetForCurrentProcess(
             DL.getGlobalPrefix())));
-    if (JTMB.getTargetTriple().isOSBinFormatCOFF()) {
-      ObjectLayer.setOverrideObjectFlagsWithResponsibilityFlags(true);
-      ObjectLayer.setAutoClaimResponsibilityForObjectSymbols(true);
-    }
   }
 
   ~KaleidoscopeJIT() {
@@ -80,8 +222,13 @@ public:
       ES->reportError(std::move(Err));
   }
 
-  static Expected<std::unique_ptr<KaleidoscopeJIT>> Create() {
-    auto EPC = SelfExecutorProcessControl::Create();
+  static Expected<std::unique_ptr<KaleidoscopeJIT>>
+  Create(const KaleidoscopeJITConfig &Config = {}) {
+    std::unique_ptr<TaskDispatcher> D;
+    if (Config.CompileThreads)
+      D = std::make_unique<FixedThreadPoolTaskDispatcher>(
+          Config.CompileThreads);
+    auto EPC = SelfExecutorProcessControl::Create(nullptr, std::move(D));
     if (!EPC)
       return EPC.takeError();
 
@@ -89,28 +236,113 @@ public:
 
     JITTargetMachineBuilder JTMB(
         ES->getExecutorProcessControl().getTargetTriple());
+    // the triple alone would give the baseline of the architecture
+    if (Config.CPU.empty() || Config.CPU == "native") {
+      JTMB.setCPU(sys::getHostCPUName().str());
+      StringMap<bool> HostFeatures;
+      if (sys::getHostCPUFeatures(HostFeatures))
+        for (const auto &Feature : HostFeatures)
+          JTMB.getFeatures().AddFeature(Feature.first(), Feature.second);
+    } else {
+      JTMB.setCPU(Config.CPU);
+    }
+    SubtargetFeatures Extra(Config.Features);
+    for (const std::string &Feature : Extra.getFeatures())
+      JTMB.getFeatures().AddFeature(Feature);
 
     auto DL = JTMB.getDefaultDataLayoutForTarget();
     if (!DL)
       return DL.takeError();
 
+    auto ObjLayer = createObjectLayer(*ES, JTMB.getTargetTriple(), Config);
+    if (!ObjLayer) {
+      if (auto Err = ES->endSession())
+        ES->reportError(std::move(Err));
+      return ObjLayer.takeError();
+    }
+
     return std::make_unique<KaleidoscopeJIT>(std::move(ES), std::move(JTMB),
-                                             std::move(*DL));
+                                             std::move(*DL),
+                                             std::move(*ObjLayer), Config);
   }
 
   const DataLayout &getDataLayout() const { return DL; }
 
+  const Triple &getTargetTriple() const { return TT; }
+
+  // A target machine for the CPU and features code is compiled for, for
+  // the IR optimizer's cost model. Not to be shared between threads.
+  Expected<std::unique_ptr<TargetMachine>> createTargetMachine() const {
+    // createTargetMachine() is not const; a copy per call keeps this
+    // callable from any thread
+    JITTargetMachineBuilder Builder(TMBuilder);
+    return Builder.createTargetMachine();
+  }
+
   JITDylib &getMainJITDylib() { return MainJD; }
 
+  SymbolStringPtr mangle(StringRef Name) { return Mangle(Name.str()); }
+
+  // Sets the IR optimizer of every module but the ones added with
+  // addModuleFast(). It may run on any thread that looks up a symbol.
+  void setOptimizer(IRTransformLayer::TransformFunction Optimize) {
+    OptimizeLayer.setTransform(std::move(Optimize));
+  }
+
+  // Sets up what addLazyModule() needs: the call-through trampolines and
+  // a stub per function that jumps to the compiler until it has a body.
+  Error enableLazyCompilation() {
+    auto LCTM = createLocalLazyCallThroughManager(
+        TT, *ES, ExecutorAddr::fromPtr(&handleLazyCallThroughError));
+    if (!LCTM)
+      return LCTM.takeError();
+    LCTMgr = std::move(*LCTM);
+    CODLayer = std::make_unique<CompileOnDemandLayer>(
+        *ES, OptimizeLayer, *LCTMgr,
+        createLocalIndirectStubsManagerBuilder(TT));
+    CODLayer->setPartitionFunction(CompileOnDemandLayer::compileRequested);
+    return Error::success();
+  }
+
   Error addModule(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr) {
     if (!RT)
       RT = MainJD.getDefaultResourceTracker();
-    return CompileLayer.add(RT, std::move(TSM));
+    return OptimizeLayer.add(RT, std::move(TSM));
+  }
+
+  // Defines the module's functions without compiling them: each is
+  // optimized and compiled on its first call.
+  Error addLazyModule(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr) {
+    if (!RT)
+      RT = MainJD.getDefaultResourceTracker();
+    return CODLayer->add(RT, std::move(TSM));
+  }
+
+  Error addModuleFast(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr) {
+    if (!RT)
+      RT = MainJD.getDefaultResourceTracker();
+    return FastCompileLayer.add(RT, std::move(TSM));
   }
 
   Expected<ExecutorSymbolDef> lookup(StringRef Name) {
     return ES->lookup({&MainJD}, Mangle(Name.str()));
   }
+
+  // Starts materializing the symbols and returns without waiting; errors
+  // go to the session's error reporter.
+  void lookupAsync(ArrayRef<std::string> Names) {
+    SymbolLookupSet Symbols;
+    for (const std::string &Name : Names)
+      Symbols.add(Mangle(Name));
+    ES->lookup(
+        LookupKind::Static, makeJITDylibSearchOrder(&MainJD),
+        std::move(Symbols), SymbolState::Ready,
+        [this](Expected<SymbolMap> Result) {
+          if (!Result)
+            ES->reportError(Result.takeError());
+        },
+        NoDependenciesToRegister);
+  }
 };
 
 } // end namespace orc
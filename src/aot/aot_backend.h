@@ -0,0 +1,585 @@
+/*
+ * File: aot_backend.h
+ * Path: /aot/aot_backend.h
+ * Module: aot
+ * Lang: C/C++
+ * Created Date: Thursday, October 22nd 2026, 4:18:06 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file turns the AOT module into objects, libraries and a C header.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "multiversion.h"
+#include "options.h"
+#include "whole_program.h"
+#include <llvm-18/llvm/ADT/ArrayRef.h>
+#include <llvm-18/llvm/ADT/SmallString.h>
+#include <llvm-18/llvm/ADT/SmallVector.h>
+#include <llvm-18/llvm/ADT/StringMap.h>
+#include <llvm-18/llvm/Bitcode/BitcodeReader.h>
+#include <llvm-18/llvm/Bitcode/BitcodeWriter.h>
+#include <llvm-18/llvm/IR/LLVMContext.h>
+#include <llvm-18/llvm/IR/LegacyPassManager.h>
+#include <llvm-18/llvm/IR/Module.h>
+#include <llvm-18/llvm/IR/Verifier.h>
+#include <llvm-18/llvm/MC/TargetRegistry.h>
+#include <llvm-18/llvm/Object/ArchiveWriter.h>
+#include <llvm-18/llvm/Support/CodeGen.h>
+#include <llvm-18/llvm/Support/Error.h>
+#include <llvm-18/llvm/Support/FileSystem.h>
+#include <llvm-18/llvm/Support/FileUtilities.h>
+#include <llvm-18/llvm/Support/MemoryBuffer.h>
+#include <llvm-18/llvm/Support/Path.h>
+#include <llvm-18/llvm/Support/Program.h>
+#include <llvm-18/llvm/Support/TargetSelect.h>
+#include <llvm-18/llvm/Support/ThreadPool.h>
+#include <llvm-18/llvm/Support/Threading.h>
+#include <llvm-18/llvm/Support/raw_ostream.h>
+#include <llvm-18/llvm/Target/TargetMachine.h>
+#include <llvm-18/llvm/Target/TargetOptions.h>
+#include <llvm-18/llvm/TargetParser/Host.h>
+#include <llvm-18/llvm/TargetParser/SubtargetFeature.h>
+#include <llvm-18/llvm/TargetParser/Triple.h>
+#include <llvm-18/llvm/Transforms/Utils/SplitModule.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The native backend of the AOT compiler (-emit). It compiles the whole
+//  program module for one target, the host by default, into a relocatable
+//  object, and from that a static library, or a shared library linked by
+//  the system's compiler driver (cc). The code is position independent so
+//  that any of them links into a PIE or a shared object.
+//
+//  Next to the output goes a C header with an extern "C" declaration of
+//  each def, double f(double, ...), for services that link the kernels in.
+//  Top-level expressions are not part of the output.
+//
+//  With setWholeProgram() (-whole-program), only the defs the header
+//  declares stay external, the module goes through the LTO pipeline (see
+//  optimizeWholeProgram) and llvm::SplitModule cuts it into a partition per
+//  thread. Each partition is handed over as bitcode, as a context cannot
+//  be shared between threads, and compiled in a context and by a target
+//  machine of its own. The partitions go into one object (cc -r), or are
+//  the members of the archive or the objects of the shared library.
+//
+//  With setMultiversion() (-multiversion), every module is made into
+//  versions for several x86-64 ISA levels right before codegen, see
+//  multiversionFunctions().
+class AotBackend {
+public:
+    using ObjectCode = llvm::SmallVector<char, 0>;
+
+    // a name C can declare
+    static bool isCName(llvm::StringRef name) {
+        if (name.empty() || std::isdigit((unsigned char)name[0])) return false;
+        for (char c : name)
+            if (!std::isalnum((unsigned char)c) && c != '_') return false;
+        return true;
+    }
+
+    // What the C header declares, and lists in comments, gathered from a
+    //  module or a definition at a time
+    struct HeaderInfo {
+        std::string decls, operators, needed;
+
+        void addDefinition(llvm::StringRef name, size_t arity) {
+            if (!isCName(name)) {
+                operators += " " + name.str();
+                return;
+            }
+            decls += "double " + name.str() + "(";
+            for (size_t i = 0; i != arity; ++i)
+                decls += i ? ", double" : "double";
+            decls += arity ? ");\n" : "void);\n";
+        }
+
+        void addNeeded(llvm::StringRef name) { needed += " " + name.str(); }
+    };
+
+    // A backend for the target triple (empty: the host) and cpu (empty:
+    //  generic; "native": the host CPU with all of its features), with the
+    //  features attrs turns on or off ("+avx2,-fma"), at the codegen level
+    //  that goes with the -O level
+    static llvm::Expected<std::unique_ptr<AotBackend>>
+    create(const std::string &triple, const std::string &cpu,
+           const std::string &attrs, unsigned optLevel) {
+        llvm::InitializeAllTargetInfos();
+        llvm::InitializeAllTargets();
+        llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmPrinters();
+
+        std::string tt = triple.empty() ? llvm::sys::getDefaultTargetTriple()
+                                        : llvm::Triple::normalize(triple);
+        std::string error;
+        const llvm::Target *target =
+            llvm::TargetRegistry::lookupTarget(tt, error);
+        if (!target) return makeError(error);
+
+        std::string cpuName = cpu.empty() ? "generic" : cpu;
+        llvm::SubtargetFeatures features;
+        if (cpu == "native") {
+            cpuName = llvm::sys::getHostCPUName().str();
+            llvm::StringMap<bool> host;
+            if (llvm::sys::getHostCPUFeatures(host))
+                for (const auto &feature : host)
+                    features.AddFeature(feature.first(), feature.second);
+        }
+        llvm::SubtargetFeatures extra(attrs);
+        for (const std::string &attr : extra.getFeatures())
+            features.AddFeature(attr);
+
+        std::unique_ptr<AotBackend> backend(new AotBackend(
+            target, tt, cpuName, features.getString(), optLevel));
+        backend->tm_ = backend->createTargetMachine();
+        if (!backend->tm_)
+            return makeError("no target machine for " + tt + ", CPU " +
+                             cpuName);
+        return std::move(backend);
+    }
+
+    // Where -emit writes when there is no -o: named after the input file,
+    //  in the current directory
+    static std::string defaultOutput(EmitKind kind, const char *inputFile) {
+        std::string stem =
+            inputFile ? llvm::sys::path::stem(inputFile).str() : "a";
+        switch (kind) {
+        case EmitKind::Archive:
+            return "lib" + stem + ".a";
+        case EmitKind::Shared:
+            return "lib" + stem + ".so";
+        default:
+            return stem + ".o";
+        }
+    }
+
+    // the header of output, beside it
+    static std::string headerFor(const std::string &output) {
+        llvm::SmallString<128> path(output);
+        llvm::sys::path::replace_extension(path, "h");
+        return path.str().str();
+    }
+
+    // Whole-program optimization and codegen on threads (0: all cores),
+    //  timed against codegen on one thread as well if compareSerial
+    void setWholeProgram(unsigned threads, bool compareSerial) {
+        wholeProgram_ = true;
+        threads_ = threads;
+        compareSerial_ = compareSerial;
+    }
+
+    const WholeProgramStats &getStats() const __attribute__((always_inline)) {
+        return stats_;
+    }
+
+    // Versions of every function for several ISA levels, picked at load
+    //  time; only for x86-64 ELF, where there are ifuncs
+    llvm::Error setMultiversion() {
+        const llvm::Triple &tt = tm_->getTargetTriple();
+        if (tt.getArch() != llvm::Triple::x86_64 || !tt.isOSBinFormatELF())
+            return makeError("-multiversion needs an x86-64 ELF target, not " +
+                             tt.str());
+        multiversion_ = true;
+        return llvm::Error::success();
+    }
+
+    const MultiversionStats &getMultiversionStats() const
+        __attribute__((always_inline)) {
+        return multiversionStats_;
+    }
+
+    // one for every thread that runs codegen or an IR pipeline (the
+    //  cost model of OptPipeline)
+    std::unique_ptr<llvm::TargetMachine> createTargetMachine() const {
+        static const llvm::CodeGenOptLevel levels[] = {
+            llvm::CodeGenOptLevel::None, llvm::CodeGenOptLevel::Less,
+            llvm::CodeGenOptLevel::Default, llvm::CodeGenOptLevel::Aggressive};
+        return std::unique_ptr<llvm::TargetMachine>(
+            target_->createTargetMachine(
+                triple_, cpu_, features_, llvm::TargetOptions(),
+                llvm::Reloc::PIC_, std::nullopt,
+                levels[std::min(optLevel_, 3u)]));
+    }
+
+    // everything besides the IR that the object code depends on
+    std::string targetKey() const {
+        return triple_ + '\0' + cpu_ + '\0' + features_ + '\0' +
+               std::to_string(optLevel_) + '\0' +
+               (multiversion_ ? "multiversion" : "");
+    }
+
+    // Gives the module the target's triple and data layout, for the IR
+    //  pipeline to see; before anything is generated into it
+    void prepare(llvm::Module &m) const {
+        m.setTargetTriple(tm_->getTargetTriple().str());
+        m.setDataLayout(tm_->createDataLayout());
+    }
+
+    // writes m as kind to path, and its header
+    llvm::Error emit(llvm::Module &m, EmitKind kind,
+                     const std::string &path) {
+        std::string broken;
+        llvm::raw_string_ostream why(broken);
+        if (llvm::verifyModule(m, &why))
+            return makeError("invalid module, nothing emitted: " + why.str());
+
+        std::vector<ObjectCode> objects;
+        if (wholeProgram_)
+            optimizeWholeProgram(m, tm_.get(), optLevel_, isExported, stats_);
+        // before -multiversion makes the functions ifuncs
+        HeaderInfo header = headerOf(m);
+        lower(m);
+        if (wholeProgram_) {
+            if (auto err = splitCodegen(m, objects)) return err;
+        } else {
+            objects.emplace_back();
+            if (auto err = codegen(m, *tm_, objects.back())) return err;
+        }
+
+        if (kind == EmitKind::None) return llvm::Error::success();
+        if (auto err = link(kind, path, objects, {})) return err;
+        return writeHeader(header, headerFor(path));
+    }
+
+    // the object code of a module on its own, as it is
+    llvm::Error compile(llvm::Module &m, ObjectCode &obj) const {
+        lower(m);
+        return codegen(m, *tm_, obj);
+    }
+
+    // compile() on any thread, by a target machine of its own
+    llvm::Error compileOnThread(llvm::Module &m, ObjectCode &obj) const {
+        lower(m);
+        std::unique_ptr<llvm::TargetMachine> tm = createTargetMachine();
+        return codegen(m, *tm, obj);
+    }
+
+    // writes kind to path from objects in memory, in this order; archive
+    //  members are named after the output if names is empty
+    llvm::Error link(EmitKind kind, const std::string &path,
+                     const std::vector<ObjectCode> &objects,
+                     const std::vector<std::string> &names) const {
+        switch (kind) {
+        case EmitKind::Object:
+            return objects.size() == 1
+                       ? writeFile(path, toStringRef(objects[0]))
+                       : linkWithCC(path, {"-r", "-nostdlib"}, objects);
+        case EmitKind::Archive:
+            return writeArchive(path, objects, names);
+        case EmitKind::Shared:
+            return linkWithCC(path, {"-shared"}, objects);
+        case EmitKind::None:
+            break;
+        }
+        return llvm::Error::success();
+    }
+
+    // writes kind to path from object files, in this order
+    llvm::Error link(EmitKind kind, const std::string &path,
+                     const std::vector<std::string> &objectFiles) const {
+        switch (kind) {
+        case EmitKind::Object:
+            if (objectFiles.size() != 1)
+                return runCC(path, {"-r", "-nostdlib"}, objectFiles);
+            if (std::error_code ec =
+                    llvm::sys::fs::copy_file(objectFiles[0], path))
+                return makeError("cannot write " + path + ": " +
+                                 ec.message());
+            return llvm::Error::success();
+        case EmitKind::Archive: {
+            std::vector<llvm::NewArchiveMember> members;
+            for (const std::string &file : objectFiles) {
+                auto member = llvm::NewArchiveMember::getFile(
+                    file, /*Deterministic=*/true);
+                if (!member) return member.takeError();
+                members.push_back(std::move(*member));
+            }
+            return writeArchive(path, members);
+        }
+        case EmitKind::Shared:
+            return runCC(path, {"-shared"}, objectFiles);
+        case EmitKind::None:
+            break;
+        }
+        return llvm::Error::success();
+    }
+
+    static llvm::Error writeHeader(const HeaderInfo &info,
+                                   const std::string &path) {
+        std::string guard;
+        for (char c : llvm::sys::path::filename(path))
+            guard += std::isalnum((unsigned char)c)
+                         ? (char)std::toupper((unsigned char)c)
+                         : '_';
+        if (guard.empty() || std::isdigit((unsigned char)guard[0]))
+            guard = "_" + guard;
+
+        std::string text = "/* The functions of a Kaleidoscope program, "
+                           "compiled by aot_compiler. */\n"
+                           "#ifndef " + guard + "\n#define " + guard +
+                           "\n\n#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
+        text += info.decls;
+        if (!info.operators.empty())
+            text += "\n/* operators, not declared:" + info.operators + " */\n";
+        if (!info.needed.empty())
+            text += "\n/* called, to be linked in:" + info.needed + " */\n";
+        text += "\n#ifdef __cplusplus\n}\n#endif\n\n#endif\n";
+        return writeFile(path, text);
+    }
+
+    static llvm::Error writeFile(const std::string &path,
+                                 llvm::StringRef bytes) {
+        std::error_code ec;
+        llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_None);
+        if (ec) return makeError("cannot write " + path + ": " + ec.message());
+        os << bytes;
+        os.close();
+        if (os.has_error()) {
+            std::string msg = os.error().message();
+            os.clear_error();
+            return makeError("cannot write " + path + ": " + msg);
+        }
+        return llvm::Error::success();
+    }
+
+private:
+    AotBackend(const llvm::Target *target, std::string triple,
+               std::string cpu, std::string features, unsigned optLevel)
+        : target_(target), triple_(std::move(triple)), cpu_(std::move(cpu)),
+          features_(std::move(features)), optLevel_(optLevel) {}
+
+    // what becomes of every module between the IR pipeline and codegen
+    void lower(llvm::Module &m) const {
+        if (multiversion_) multiversionFunctions(m, multiversionStats_);
+    }
+
+    static llvm::StringRef toStringRef(const ObjectCode &obj) {
+        return llvm::StringRef(obj.data(), obj.size());
+    }
+
+    static llvm::Error codegen(llvm::Module &m, llvm::TargetMachine &tm,
+                               ObjectCode &obj) {
+        llvm::raw_svector_ostream os(obj);
+        llvm::legacy::PassManager pm;
+        if (tm.addPassesToEmitFile(pm, os, nullptr,
+                                   llvm::CodeGenFileType::ObjectFile))
+            return makeError("cannot emit objects for " +
+                             tm.getTargetTriple().str());
+        pm.run(m);
+        return llvm::Error::success();
+    }
+
+    // codegen of a module given as bitcode, on any thread
+    llvm::Error codegenBitcode(llvm::StringRef bitcode,
+                               ObjectCode &obj) const {
+        llvm::LLVMContext context;
+        auto m = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(bitcode, "partition"), context);
+        if (!m) return m.takeError();
+        std::unique_ptr<llvm::TargetMachine> tm = createTargetMachine();
+        return codegen(**m, *tm, obj);
+    }
+
+    llvm::Error splitCodegen(llvm::Module &m,
+                             std::vector<ObjectCode> &objects) {
+        using Clock = std::chrono::steady_clock;
+        llvm::ThreadPoolStrategy strategy =
+            llvm::hardware_concurrency(threads_);
+        stats_.threads = strategy.compute_thread_count();
+
+        // the reference, from bitcode too, before SplitModule changes m
+        if (compareSerial_) {
+            llvm::SmallString<0> whole;
+            llvm::raw_svector_ostream os(whole);
+            llvm::WriteBitcodeToFile(m, os);
+            ObjectCode discard;
+            auto t0 = Clock::now();
+            if (auto err = codegenBitcode(whole, discard)) return err;
+            stats_.serialSeconds = secondsSince(t0);
+        }
+
+        auto t0 = Clock::now();
+        // PreserveLocals off, as in LTO: an internal function may go to
+        //  another partition than its callers, which then reach it as a
+        //  hidden symbol
+        std::vector<llvm::SmallString<0>> parts;
+        llvm::SplitModule(
+            m, stats_.threads,
+            [&parts](std::unique_ptr<llvm::Module> part) {
+                bool empty = true;
+                for (const llvm::GlobalValue &gv : part->global_values())
+                    empty &= gv.isDeclaration();
+                if (empty) return;
+                parts.emplace_back();
+                llvm::raw_svector_ostream os(parts.back());
+                llvm::WriteBitcodeToFile(*part, os);
+            },
+            /*PreserveLocals=*/false);
+        stats_.partitions = parts.size();
+
+        objects.resize(parts.size());
+        std::vector<std::string> errors(parts.size());
+        {
+            llvm::ThreadPool pool(strategy);
+            for (size_t i = 0; i != parts.size(); ++i)
+                pool.async([this, &parts, &objects, &errors, i] {
+                    if (auto err = codegenBitcode(parts[i], objects[i]))
+                        errors[i] = llvm::toString(std::move(err));
+                });
+            pool.wait();
+        }
+        stats_.codegenSeconds = secondsSince(t0);
+        for (const std::string &error : errors)
+            if (!error.empty()) return makeError(error);
+        return llvm::Error::success();
+    }
+
+    static double secondsSince(std::chrono::steady_clock::time_point t0) {
+        std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        return dt.count();
+    }
+
+    // -whole-program keeps what the header declares
+    static bool isExported(const llvm::GlobalValue &gv) {
+        return llvm::isa<llvm::Function>(gv) && isCName(gv.getName());
+    }
+
+    static llvm::Error makeError(const std::string &msg) {
+        return llvm::make_error<llvm::StringError>(
+            msg, llvm::inconvertibleErrorCode());
+    }
+
+    llvm::Error writeArchive(const std::string &path,
+                             const std::vector<ObjectCode> &objects,
+                             const std::vector<std::string> &names) const {
+        std::string stem = llvm::sys::path::stem(path).str();
+        std::vector<llvm::NewArchiveMember> members(objects.size());
+        for (size_t i = 0; i != objects.size(); ++i) {
+            std::string name =
+                !names.empty() ? names[i]
+                               : stem + (i ? "." + std::to_string(i) : "") +
+                                     ".o";
+            members[i].Buf = llvm::MemoryBuffer::getMemBufferCopy(
+                toStringRef(objects[i]), name);
+            members[i].MemberName = members[i].Buf->getBufferIdentifier();
+        }
+        return writeArchive(path, members);
+    }
+
+    llvm::Error
+    writeArchive(const std::string &path,
+                 llvm::ArrayRef<llvm::NewArchiveMember> members) const {
+        const llvm::Triple &tt = tm_->getTargetTriple();
+        auto format = tt.isOSDarwin() ? llvm::object::Archive::K_DARWIN
+                      : tt.isOSAIX()  ? llvm::object::Archive::K_AIXBIG
+                                      : llvm::object::Archive::K_GNU;
+        return llvm::writeArchive(path, members,
+                                  llvm::SymtabWritingMode::NormalSymtab,
+                                  format, /*Deterministic=*/true,
+                                  /*Thin=*/false);
+    }
+
+    // The objects go through temporary files to cc (see runCC)
+    static llvm::Error linkWithCC(const std::string &path,
+                                  llvm::ArrayRef<llvm::StringRef> flags,
+                                  const std::vector<ObjectCode> &objects) {
+        std::vector<std::string> tmps(objects.size());
+        std::vector<std::unique_ptr<llvm::FileRemover>> removeTmps;
+        for (size_t i = 0; i != objects.size(); ++i) {
+            llvm::SmallString<128> tmp;
+            if (std::error_code ec = llvm::sys::fs::createTemporaryFile(
+                    "kaleidoscope", "o", tmp))
+                return makeError("cannot create a temporary object: " +
+                                 ec.message());
+            tmps[i] = tmp.str().str();
+            removeTmps.push_back(std::make_unique<llvm::FileRemover>(tmp));
+            if (auto err = writeFile(tmps[i], toStringRef(objects[i])))
+                return err;
+        }
+        return runCC(path, flags, tmps);
+    }
+
+    // Runs cc with -shared for a library, or -r to join objects into one.
+    //  The functions the program only declares, printd and the like, are
+    //  left for the executable that loads the library to provide. When the
+    //  objects do not fit on a command line they are listed in a response
+    //  file.
+    static llvm::Error runCC(const std::string &path,
+                             llvm::ArrayRef<llvm::StringRef> flags,
+                             const std::vector<std::string> &objectFiles) {
+        llvm::ErrorOr<std::string> cc = llvm::sys::findProgramByName("cc");
+        if (!cc) return makeError("no cc to link " + path + " with");
+        std::vector<llvm::StringRef> args = {*cc};
+        args.insert(args.end(), flags.begin(), flags.end());
+        args.push_back("-o");
+        args.push_back(path);
+        size_t head = args.size();
+        for (const std::string &file : objectFiles) args.push_back(file);
+
+        llvm::SmallString<128> rsp;
+        std::unique_ptr<llvm::FileRemover> removeRsp;
+        std::string rspArg;
+        if (!llvm::sys::commandLineFitsWithinSystemLimits(*cc, args)) {
+            if (std::error_code ec = llvm::sys::fs::createTemporaryFile(
+                    "kaleidoscope", "rsp", rsp))
+                return makeError("cannot create a response file: " +
+                                 ec.message());
+            removeRsp = std::make_unique<llvm::FileRemover>(rsp);
+            std::string list;
+            llvm::raw_string_ostream os(list);
+            for (const std::string &file : objectFiles) {
+                llvm::sys::printArg(os, file, /*Quote=*/true);
+                os << '\n';
+            }
+            if (auto err = writeFile(rsp.str().str(), os.str())) return err;
+            rspArg = "@" + rsp.str().str();
+            args.resize(head);
+            args.push_back(rspArg);
+        }
+
+        std::string msg;
+        int rc = llvm::sys::ExecuteAndWait(*cc, args, {}, {}, 0, 0, &msg);
+        if (rc != 0)
+            return makeError("cc could not link " + path +
+                             (msg.empty() ? "" : ": " + msg));
+        return llvm::Error::success();
+    }
+
+    // Operators are defined as functions named binary| and the like, which
+    //  are in the object but cannot be declared in C; the header lists them
+    //  and what the program calls without defining in comments. Hidden
+    //  functions are internal ones SplitModule shared between partitions.
+    static HeaderInfo headerOf(const llvm::Module &m) {
+        HeaderInfo info;
+        for (const llvm::Function &f : m) {
+            if (f.isDeclaration()) {
+                if (!f.use_empty()) info.addNeeded(f.getName());
+                continue;
+            }
+            if (f.hasExternalLinkage() && !f.hasHiddenVisibility())
+                info.addDefinition(f.getName(), f.arg_size());
+        }
+        return info;
+    }
+
+    const llvm::Target *target_;
+    const std::string triple_, cpu_, features_;
+    const unsigned optLevel_;
+    std::unique_ptr<llvm::TargetMachine> tm_;
+    bool wholeProgram_ = false;
+    unsigned threads_ = 0;
+    bool compareSerial_ = false;
+    WholeProgramStats stats_;
+    bool multiversion_ = false;
+    // counted by compile(), on any thread
+    mutable MultiversionStats multiversionStats_;
+};
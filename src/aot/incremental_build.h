@@ -0,0 +1,310 @@
+/*
+ * File: incremental_build.h
+ * Path: /aot/incremental_build.h
+ * Module: aot
+ * Lang: C/C++
+ * Created Date: Friday, October 23rd 2026, 10:12:35 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file rebuilds only the definitions of an AOT program that changed.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "aot_backend.h"
+#include "ast.h"
+#include "compiler_type.h"
+#include "interner.h"
+#include "logger.h"
+#include "options.h"
+#include "parser_env.h"
+#include "token.h"
+#include "token_stream.h"
+#include <llvm-18/llvm/ADT/ArrayRef.h>
+#include <llvm-18/llvm/ADT/SmallString.h>
+#include <llvm-18/llvm/ADT/StringExtras.h>
+#include <llvm-18/llvm/Support/BLAKE3.h>
+#include <llvm-18/llvm/IR/Function.h>
+#include <llvm-18/llvm/Support/Error.h>
+#include <llvm-18/llvm/Support/FileSystem.h>
+#include <llvm-18/llvm/Support/MemoryBuffer.h>
+#include <llvm-18/llvm/Support/Path.h>
+#include <llvm-18/llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <unordered_set>
+#include <vector>
+
+// What IncrementalBuild did, for -stats
+struct IncrementalStats {
+    size_t definitions = 0;
+    size_t reused = 0;  // objects found in the build directory
+    size_t rebuilt = 0; // optimized and compiled
+    double rebuildSeconds = 0;
+    bool relinked = false;
+    double linkSeconds = 0;
+
+    void print() const {
+        fprintf(stderr,
+                "incremental: %zu definitions, %zu reused, %zu rebuilt in "
+                "%.2f ms, ",
+                definitions, reused, rebuilt, rebuildSeconds * 1e3);
+        if (relinked)
+            fprintf(stderr, "relinked in %.2f ms\n", linkSeconds * 1e3);
+        else
+            fprintf(stderr, "output up to date\n");
+    }
+};
+
+// The AOT compiler's incremental mode (-incremental DIR). Every def is
+//  compiled on its own, in a module of its own, to an object file in the
+//  build directory named by a key of everything its code depends on:
+//  - its tokens, which include its prototype;
+//  - the precedence of every operator character in it, which decides how
+//    its body parses;
+//  - the arity of every function its names and operators may refer to,
+//    declared by a def or an extern before it;
+//  - the target, the optimization level and the codegen options.
+//  A def whose key has an object is only declared, for the defs after it;
+//  the others are optimized and compiled, and their IR printed. The
+//  output is then linked from the objects in source order, unless it is
+//  there already from the same objects.
+//
+//  As each def is optimized alone, nothing is inlined across defs: the
+//  cost of not redoing the whole program on every change. Objects are
+//  written under a temporary name and renamed, and never evicted, like
+//  DiskObjectCache does.
+class IncrementalBuild {
+    static constexpr CompilerType CT = CompilerType::AOT;
+
+public:
+    IncrementalBuild(std::string dir, const CompilerOptions &opts,
+                     AotBackend &backend,
+                     std::shared_ptr<const TokenStream> tokens,
+                     ParserEnv<CT> *env)
+        : dir_(std::move(dir)), backend_(backend), tokens_(std::move(tokens)),
+          env_(env) {
+        std::string config = "kaleidoscope-incremental-1\n" +
+                             backend.targetKey() +
+                             (opts.flatCodegen ? "\nflat" : "\ntree") +
+                             (opts.astOpt ? "\nast-opt" : "\nno-ast-opt");
+        auto digest = hash(config);
+        config_.assign(digest.begin(), digest.end());
+        if (std::error_code ec = llvm::sys::fs::create_directories(dir_))
+            error_ = ec.message();
+    }
+
+    IncrementalBuild(const IncrementalBuild &) = delete;
+    IncrementalBuild &operator=(const IncrementalBuild &) = delete;
+
+    // empty if the build directory is usable
+    const std::string &getError() const __attribute__((always_inline)) {
+        return error_;
+    }
+
+    const IncrementalStats &getStats() const __attribute__((always_inline)) {
+        return stats_;
+    }
+
+    // Takes the def at tokens [begin, end), just parsed, if its object is
+    //  in the build directory or it is in error. If not, rebuild() is
+    //  next, once the def is lowered (FunctionAST::lower()).
+    bool reuse(FunctionAST<CT> &fn, size_t begin, size_t end) {
+        const PrototypeAST<CT> &proto = fn.getProto();
+        if (defined_.count(proto.getSymbol())) {
+            LogErrorV<CT>("function cannot be redefined");
+            return true;
+        }
+        ++stats_.definitions;
+        pending_ = dir_ + "/" + keyOf(begin, end) + ".o";
+        if (!llvm::sys::fs::exists(pending_)) return false;
+        ++stats_.reused;
+        fn.declare();
+        added(proto, pending_);
+        return true;
+    }
+
+    llvm::Error rebuild(FunctionAST<CT> &fn) {
+        const PrototypeAST<CT> &proto = fn.getProto();
+        auto t0 = std::chrono::steady_clock::now();
+        llvm::Function *ir = fn.codegen();
+        if (!ir) return llvm::Error::success();
+        fprintf(stderr, "Parsed a function definition.\n");
+        ir->print(llvm::errs());
+        fprintf(stderr, "\n");
+        // for the defs after it, which get modules of their own
+        fn.declare();
+        env_->optimizeModule();
+        AotBackend::ObjectCode obj;
+        llvm::Error compiled = backend_.compile(*env_->getModule(), obj);
+        env_->takeModule();
+        backend_.prepare(*env_->getModule());
+        if (compiled) return compiled;
+        if (auto err = store(pending_, obj)) return err;
+        added(proto, pending_);
+        ++stats_.rebuilt;
+        std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        stats_.rebuildSeconds += dt.count();
+        return llvm::Error::success();
+    }
+
+    // an extern, after codegen
+    void addExtern(const PrototypeAST<CT> &proto) {
+        externs_.push_back(proto.getSymbol());
+    }
+
+    // Links kind to path from the objects of the defs read, and writes its
+    //  header, unless the last link of path was from the same objects
+    llvm::Error link(EmitKind kind, const std::string &path) {
+        if (objects_.empty())
+            return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                           "no definitions to emit");
+        for (SymbolId name : externs_)
+            if (!defined_.count(name))
+                header_.addNeeded(Interner::global().str(name));
+
+        llvm::SmallString<256> absPath(path);
+        llvm::sys::fs::make_absolute(absPath);
+        std::string inputs = std::to_string((int)kind) + '\n' +
+                             absPath.str().str() + '\n' + header_.decls +
+                             header_.operators + '\n' + header_.needed + '\n';
+        for (const std::string &object : objects_) inputs += object + '\n';
+        std::string stamp = dir_ + "/" + hexDigest(absPath.str()) + ".link";
+        std::string digest = hexDigest(inputs);
+        std::string header = AotBackend::headerFor(path);
+
+        auto last = llvm::MemoryBuffer::getFile(stamp);
+        if (last && (*last)->getBuffer() == digest &&
+            llvm::sys::fs::exists(path) && llvm::sys::fs::exists(header))
+            return llvm::Error::success();
+
+        auto t0 = std::chrono::steady_clock::now();
+        // a failed link must not leave the stamp of the one before
+        llvm::sys::fs::remove(stamp);
+        if (auto err = backend_.link(kind, path, objects_)) return err;
+        if (auto err = AotBackend::writeHeader(header_, header)) return err;
+        if (auto err = AotBackend::writeFile(stamp, digest)) return err;
+        stats_.relinked = true;
+        std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        stats_.linkSeconds = dt.count();
+        return llvm::Error::success();
+    }
+
+private:
+    void added(const PrototypeAST<CT> &proto, const std::string &object) {
+        defined_.insert(proto.getSymbol());
+        header_.addDefinition(proto.getName(), proto.getArgs().size());
+        objects_.push_back(object);
+    }
+
+    // BLAKE3 rather than the SHA-256 of DiskObjectCache: it runs for every
+    //  def of every build, and is several times faster
+    static llvm::BLAKE3Result<> hash(llvm::StringRef bytes) {
+        return llvm::BLAKE3::hash(llvm::ArrayRef<uint8_t>(
+            reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size()));
+    }
+
+    static std::string hexDigest(llvm::StringRef bytes) {
+        return llvm::toHex(hash(bytes), /*LowerCase=*/true);
+    }
+
+    // as raw bytes, this machine's own encoding
+    template <typename T> static void append(std::string &bytes, T value) {
+        bytes.append(reinterpret_cast<const char *>(&value), sizeof value);
+    }
+
+    // arity of the function env knows as sym, -1 if none
+    int arity(SymbolId sym) const {
+        const PrototypeAST<CT> *proto = env_->getProto(sym);
+        return proto ? (int)proto->getArgs().size() : -1;
+    }
+
+    // The tokens, then what the env says of the operator characters and
+    //  the names among them: the names by name, which does not change from
+    //  run to run as a SymbolId may
+    std::string keyOf(size_t begin, size_t end) const {
+        std::string bytes = config_;
+        std::vector<SymbolId> names;
+        bool ops[256] = {};
+        for (size_t i = begin; i != end; ++i) {
+            int kind = tokens_->kind(i);
+            append(bytes, (int16_t)kind);
+            bytes += tokens_->text(i);
+            bytes += '\0';
+            if (kind == tokIdentifier)
+                names.push_back(tokens_->symbol(i));
+            else if (kind > 0 && kind < 256)
+                ops[kind] = kind != '(' && kind != ')' && kind != ',' &&
+                            kind != ';';
+        }
+
+        for (int op = 0; op != 256; ++op) {
+            if (!ops[op]) continue;
+            bytes += (char)op;
+            append(bytes, env_->getBinoPrecedence((char)op));
+            append(bytes, arity(Interner::global().unaryOp((char)op)));
+            append(bytes, arity(Interner::global().binaryOp((char)op)));
+        }
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        std::vector<std::pair<std::string_view, int>> deps;
+        deps.reserve(names.size());
+        for (SymbolId name : names)
+            deps.emplace_back(Interner::global().str(name), arity(name));
+        std::sort(deps.begin(), deps.end());
+        for (const auto &dep : deps) {
+            bytes += dep.first;
+            bytes += '\0';
+            append(bytes, dep.second);
+        }
+        return hexDigest(bytes);
+    }
+
+    // under a temporary name first, for concurrent builds
+    llvm::Error store(const std::string &path,
+                      const AotBackend::ObjectCode &obj) const {
+        int fd;
+        llvm::SmallString<128> tmp;
+        if (std::error_code ec = llvm::sys::fs::createUniqueFile(
+                dir_ + "/%%%%%%%%.tmp", fd, tmp))
+            return llvm::errorCodeToError(ec);
+        llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+        os << llvm::StringRef(obj.data(), obj.size());
+        os.close();
+        std::error_code ec = os.error();
+        os.clear_error();
+        if (!ec) ec = llvm::sys::fs::rename(tmp, path);
+        if (!ec) return llvm::Error::success();
+        llvm::sys::fs::remove(tmp);
+        return llvm::createStringError(ec, "cannot write %s: %s",
+                                       path.c_str(), ec.message().c_str());
+    }
+
+    const std::string dir_;
+    // digest of the target and the options, the start of every key
+    std::string config_;
+    std::string error_;
+    AotBackend &backend_;
+    std::shared_ptr<const TokenStream> tokens_;
+    ParserEnv<CT> *env_;
+    // object files in source order, and what the header declares
+    std::vector<std::string> objects_;
+    // the object of the def between reuse() and rebuild()
+    std::string pending_;
+    AotBackend::HeaderInfo header_;
+    std::unordered_set<SymbolId> defined_;
+    std::vector<SymbolId> externs_;
+    IncrementalStats stats_;
+};
@@ -0,0 +1,299 @@
+/*
+ * File: multi_file_build.h
+ * Path: /aot/multi_file_build.h
+ * Module: aot
+ * Lang: C/C++
+ * Created Date: Friday, October 23rd 2026, 3:26:51 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file compiles many AOT input files side by side and links them.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "aot_backend.h"
+#include "ast_stats.h"
+#include "compiler_type.h"
+#include "file_stats.h"
+#include "lexer.h"
+#include "logger.h"
+#include "options.h"
+#include "parser.h"
+#include "parser_env.h"
+#include "source_buffer.h"
+#include "token_stream.h"
+#include <llvm-18/llvm/ADT/StringMap.h>
+#include <llvm-18/llvm/ADT/StringSet.h>
+#include <llvm-18/llvm/IR/Function.h>
+#include <llvm-18/llvm/IR/Module.h>
+#include <llvm-18/llvm/Support/Error.h>
+#include <llvm-18/llvm/Support/Path.h>
+#include <llvm-18/llvm/Support/ThreadPool.h>
+#include <llvm-18/llvm/Support/Threading.h>
+#include <llvm-18/llvm/Support/raw_ostream.h>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The AOT compiler given more than one input file, or a -prelude. The
+//  driver has run the prelude into its own env first; then every file is
+//  lexed, parsed, optimized and compiled to object code on a pool thread,
+//  in a module and by a target machine of its own, while the main thread
+//  compiles the prelude's module. A file sees the prototypes and operator
+//  precedences of the prelude, which nobody changes by then, and nothing
+//  of the other files: a call from one file to another goes through an
+//  extern, as in C, and each optimizes alone. What each file logs, its
+//  errors included, is printed in command line order once it is done.
+//
+//  The link takes the objects in the same order, the prelude's first,
+//  whatever order they were done in, so the output is the same from run to
+//  run; a function defined in two of them is an error. Without -emit each
+//  file's module is printed, as the single-file compiler prints its own.
+class MultiFileBuild {
+    static constexpr CompilerType CT = CompilerType::AOT;
+
+public:
+    // backend: nullptr without -emit
+    MultiFileBuild(const CompilerOptions &opts, const AotBackend *backend,
+                   ParserEnv<CT> *prelude, std::string preludeName)
+        : backend_(backend), prelude_(prelude), jobs_(opts.jobs),
+          flatCodegen_(opts.flatCodegen), astOpt_(opts.astOpt) {
+        preludeUnit_.stats.name = std::move(preludeName);
+    }
+
+    MultiFileBuild(const MultiFileBuild &) = delete;
+    MultiFileBuild &operator=(const MultiFileBuild &) = delete;
+
+    void addFile(std::string name, std::unique_ptr<SourceBuffer> source) {
+        files_.emplace_back();
+        files_.back().stats.name = std::move(name);
+        files_.back().source = std::move(source);
+    }
+
+    // compiles the files, and the prelude's module with -emit
+    llvm::Error run() {
+        auto t0 = std::chrono::steady_clock::now();
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs_));
+        threads_ = pool.getThreadCount();
+        std::vector<std::shared_future<void>> done;
+        done.reserve(files_.size());
+        for (Unit &file : files_)
+            done.push_back(pool.async([this, &file] { compileFile(file); }));
+
+        if (backend_) {
+            symbolsOf(*prelude_->getModule(), preludeUnit_);
+            if (!preludeUnit_.defs.empty())
+                if (auto err = backend_->compile(*prelude_->getModule(),
+                                                 preludeUnit_.object))
+                    preludeUnit_.error = llvm::toString(std::move(err));
+        } else {
+            prelude_->printErr();
+        }
+        for (size_t i = 0; i != files_.size(); ++i) {
+            done[i].wait();
+            fputs(files_[i].log.c_str(), stderr);
+            files_[i].log.clear();
+            astStats_ += files_[i].astStats;
+            optStats_ += files_[i].optStats;
+        }
+        pool.wait();
+        std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        wallSeconds_ = dt.count();
+
+        if (!preludeUnit_.error.empty()) return makeError(preludeUnit_);
+        for (const Unit &file : files_)
+            if (!file.error.empty()) return makeError(file);
+        return llvm::Error::success();
+    }
+
+    // Links kind to path from the objects, in order, and writes the header
+    //  of all of them
+    llvm::Error link(EmitKind kind, const std::string &path) {
+        std::vector<Unit *> units = {&preludeUnit_};
+        for (Unit &file : files_) units.push_back(&file);
+
+        std::vector<AotBackend::ObjectCode> objects;
+        std::vector<std::string> names;
+        AotBackend::HeaderInfo header;
+        llvm::StringMap<const std::string *> definedIn;
+        for (Unit *unit : units) {
+            // externs only, or nothing
+            if (unit->defs.empty()) continue;
+            for (const auto &def : unit->defs) {
+                auto in = definedIn.try_emplace(def.first, &unit->stats.name);
+                if (!in.second)
+                    return llvm::createStringError(
+                        llvm::inconvertibleErrorCode(),
+                        "%s is defined in %s and in %s", def.first.c_str(),
+                        in.first->second->c_str(),
+                        unit->stats.name.c_str());
+                header.addDefinition(def.first, def.second);
+            }
+            objects.push_back(std::move(unit->object));
+            names.push_back(llvm::sys::path::stem(unit->stats.name).str() +
+                            ".o");
+        }
+        if (objects.empty())
+            return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                           "no definitions to emit");
+        llvm::StringSet<> needed;
+        for (Unit *unit : units)
+            for (const std::string &name : unit->needed)
+                if (!definedIn.count(name) && needed.insert(name).second)
+                    header.addNeeded(name);
+
+        if (auto err = backend_->link(kind, path, objects, names)) return err;
+        return AotBackend::writeHeader(header, AotBackend::headerFor(path));
+    }
+
+    // summed over the files, the prelude is the driver's
+    const AstStats &getAstStats() const __attribute__((always_inline)) {
+        return astStats_;
+    }
+
+    const OptStats &getOptStats() const __attribute__((always_inline)) {
+        return optStats_;
+    }
+
+    void printStats() const {
+        std::vector<FileStats> files;
+        for (const Unit &file : files_) files.push_back(file.stats);
+        printFileStats(files, threads_, wallSeconds_);
+    }
+
+private:
+    // the prelude or a file, and what became of it
+    struct Unit {
+        std::unique_ptr<SourceBuffer> source;
+        std::string log;
+        AotBackend::ObjectCode object;
+        // what the object defines, with the arities, and calls undefined
+        std::vector<std::pair<std::string, size_t>> defs;
+        std::vector<std::string> needed;
+        std::string error;
+        AstStats astStats;
+        OptStats optStats;
+        FileStats stats;
+    };
+
+    // the same loop as Driver::mainLoop(), on a pool thread
+    void compileFile(Unit &file) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::shared_ptr<const TokenStream> tokens =
+            Lexer(std::move(file.source)).tokenize();
+        file.stats.tokens = tokens->size();
+        auto workerEnv = std::make_unique<ParserEnv<CT>>(
+            prelude_->getOptLevel());
+        workerEnv->initializeWorker(
+            "", prelude_->getBinoPrecedences(),
+            [this](SymbolId sym) { return prelude_->getProto(sym); },
+            prelude_->getTargetMachineFactory());
+        if (backend_) backend_->prepare(*workerEnv->getModule());
+        Parser<CT> parser(tokens, 0, tokens->size(), std::move(workerEnv));
+        ParserEnv<CT> *env = parser.getEnv();
+        llvm::raw_string_ostream os(file.log);
+        ScopedErrorSink errors(os);
+
+        for (int tok; (tok = parser.getCurToken()) != tokEof;) {
+            switch (tok) {
+            case ';':
+                parser.getNextToken();
+                break;
+            case tokDef:
+                if (auto defAST = parser.parseDefinition()) {
+                    defAST->lower(flatCodegen_, astOpt_, file.astStats.opt);
+                    file.astStats.record(*defAST);
+                    if (auto *defIR = defAST->codegen()) {
+                        os << "Parsed a function definition.\n";
+                        defIR->print(os);
+                        os << "\n";
+                    }
+                } else {
+                    parser.getNextToken();
+                }
+                break;
+            case tokExtern:
+                if (auto protoAST = parser.parseExtern()) {
+                    if (auto *protoIR = protoAST->codegen()) {
+                        os << "Read an extern: ";
+                        protoIR->print(os);
+                        os << "\n";
+                        env->addProto(protoAST);
+                    }
+                } else {
+                    parser.getNextToken();
+                }
+                break;
+            default:
+                if (auto fnAST = parser.parseTopLevelExpr()) {
+                    fnAST->lower(flatCodegen_, astOpt_, file.astStats.opt);
+                    file.astStats.record(*fnAST);
+                    if (auto *fnIR = fnAST->codegen()) {
+                        os << "Read a top-level expr: ";
+                        fnIR->print(os);
+                        os << "\n";
+                        // not part of the output
+                        fnIR->eraseFromParent();
+                    }
+                } else {
+                    parser.getNextToken();
+                }
+                break;
+            }
+        }
+
+        env->optimizeModule();
+        file.optStats = env->getOptStats();
+        llvm::Module &m = *env->getModule();
+        if (backend_) {
+            symbolsOf(m, file);
+            if (!file.defs.empty())
+                if (auto err = backend_->compileOnThread(m, file.object))
+                    file.error = llvm::toString(std::move(err));
+        } else {
+            m.print(os, nullptr);
+        }
+        os.flush();
+        std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        file.stats.seconds = dt.count();
+    }
+
+    // what the header of m would have, see AotBackend::headerOf()
+    static void symbolsOf(const llvm::Module &m, Unit &unit) {
+        for (const llvm::Function &f : m) {
+            if (f.isDeclaration()) {
+                if (!f.use_empty()) unit.needed.push_back(f.getName().str());
+            } else if (f.hasExternalLinkage()) {
+                unit.defs.emplace_back(f.getName().str(), f.arg_size());
+            }
+        }
+    }
+
+    static llvm::Error makeError(const Unit &unit) {
+        return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                       "%s: %s", unit.stats.name.c_str(),
+                                       unit.error.c_str());
+    }
+
+    const AotBackend *backend_;
+    // the driver's, which ran the prelude
+    ParserEnv<CT> *prelude_;
+    const unsigned jobs_;
+    const bool flatCodegen_;
+    const bool astOpt_;
+    Unit preludeUnit_;
+    std::vector<Unit> files_;
+    unsigned threads_ = 0;
+    double wallSeconds_ = 0;
+    AstStats astStats_;
+    OptStats optStats_;
+};
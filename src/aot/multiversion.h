@@ -0,0 +1,197 @@
+/*
+ * File: multiversion.h
+ * Path: /aot/multiversion.h
+ * Module: aot
+ * Lang: C/C++
+ * Created Date: Friday, October 23rd 2026, 5:08:44 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file clones the AOT functions for several x86-64 ISA levels.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <llvm-18/llvm/ADT/SmallVector.h>
+#include <llvm-18/llvm/IR/Constants.h>
+#include <llvm-18/llvm/IR/DerivedTypes.h>
+#include <llvm-18/llvm/IR/Function.h>
+#include <llvm-18/llvm/IR/GlobalIFunc.h>
+#include <llvm-18/llvm/IR/GlobalVariable.h>
+#include <llvm-18/llvm/IR/IRBuilder.h>
+#include <llvm-18/llvm/IR/Instructions.h>
+#include <llvm-18/llvm/IR/Module.h>
+#include <llvm-18/llvm/Transforms/Utils/Cloning.h>
+#include <llvm-18/llvm/Transforms/Utils/ValueMapper.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// -multiversion, for -stats; summed over every module compiled, on any
+//  thread
+struct MultiversionStats {
+    std::atomic<size_t> functions{0}; // defined, each in every version
+    std::atomic<size_t> dispatched{0}; // external, so behind an ifunc
+
+    void print() const {
+        fprintf(stderr,
+                "multiversion: %zu functions in sse2, avx2 and avx512 "
+                "versions for x86-64 (not -mcpu or -mattr), %zu picked at "
+                "load time\n",
+                functions.load(), dispatched.load());
+    }
+};
+
+// A version of the functions, for the CPUs that have all of cpuFeatures:
+//  the bits of __cpu_model.__cpu_features[0] that libgcc and compiler-rt
+//  set (their enum processor_features), which are the ones target
+//  turns on.
+struct IsaLevel {
+    const char *suffix;
+    const char *target; // "target-features" of the version, on x86-64
+    uint32_t cpuFeatures;
+};
+
+// The CPU of every version, and of the code that picks one. The function
+//  attributes replace the target machine's CPU and features, so an -mcpu
+//  or -mattr above the baseline cannot leak into the sse2 version (or AVX-512
+//  into the avx2 one), which would fault on the CPUs it is picked for.
+inline constexpr const char *kBaselineCpu = "x86-64";
+
+// best last; the first runs on any x86-64
+inline constexpr uint32_t kAvx2Bits =
+    1u << 10 | 1u << 14 | 1u << 16 | 1u << 17; // avx2 fma bmi bmi2
+inline constexpr IsaLevel kIsaLevels[] = {
+    {"sse2", "", 0},
+    {"avx2", "+avx2,+fma,+bmi,+bmi2", kAvx2Bits},
+    // avx512f vl bw dq cd
+    {"avx512",
+     "+avx2,+fma,+bmi,+bmi2,+avx512f,+avx512vl,+avx512bw,+avx512dq,"
+     "+avx512cd",
+     kAvx2Bits | 1u << 15 | 1u << 20 | 1u << 21 | 1u << 22 | 1u << 23},
+};
+
+// Builds f for level instead of for the target machine.
+inline void setIsaLevel(llvm::Function &f, const IsaLevel &level) {
+    f.addFnAttr("target-cpu", kBaselineCpu);
+    f.addFnAttr("target-features", level.target);
+}
+
+// Function multiversioning as clang does it for target_clones, on every
+//  definition of m. The module becomes a copy of its functions per
+//  IsaLevel, in which each call goes to the callee of the same level, so
+//  the code of a level never runs on a CPU without its features. An
+//  external function f becomes f.sse2, f.avx2 and f.avx512, all internal,
+//  and f an ifunc: the dynamic loader (or the startup code of a static
+//  executable) calls its resolver once, which asks libgcc's or
+//  compiler-rt's __cpu_indicator_init() what the CPU has, before any
+//  constructor ran, and binds f to the best version it can run.
+//
+//  Only the instruction selection differs between the versions: the IR
+//  was optimized once before. Each version is built for x86-64 and its
+//  features, whatever -mcpu and -mattr ask for.
+inline void multiversionFunctions(llvm::Module &m, MultiversionStats &stats) {
+    std::vector<llvm::Function *> defs;
+    for (llvm::Function &f : m)
+        if (!f.isDeclaration()) defs.push_back(&f);
+    if (defs.empty()) return;
+
+    constexpr size_t kLevels = sizeof(kIsaLevels) / sizeof(kIsaLevels[0]);
+    // versions[i][level], level 0 being the function itself
+    std::vector<llvm::SmallVector<llvm::Function *, kLevels>> versions(
+        defs.size());
+    for (size_t i = 0; i != defs.size(); ++i) versions[i].push_back(defs[i]);
+    for (size_t level = 1; level != kLevels; ++level) {
+        // all of them declared first, for the calls between them to map
+        llvm::ValueToValueMapTy vmap;
+        for (size_t i = 0; i != defs.size(); ++i) {
+            llvm::Function *f = defs[i];
+            llvm::Function *clone = llvm::Function::Create(
+                f->getFunctionType(), llvm::Function::InternalLinkage,
+                f->getName() + "." + kIsaLevels[level].suffix, &m);
+            vmap[f] = clone;
+            versions[i].push_back(clone);
+        }
+        for (size_t i = 0; i != defs.size(); ++i) {
+            llvm::Function *f = defs[i], *clone = versions[i][level];
+            auto arg = clone->arg_begin();
+            for (const llvm::Argument &a : f->args()) {
+                arg->setName(a.getName());
+                vmap[&a] = &*arg++;
+            }
+            llvm::SmallVector<llvm::ReturnInst *, 4> returns;
+            llvm::CloneFunctionInto(
+                clone, f, vmap,
+                llvm::CloneFunctionChangeType::LocalChangesOnly, returns);
+            clone->setLinkage(llvm::Function::InternalLinkage);
+            setIsaLevel(*clone, kIsaLevels[level]);
+        }
+    }
+    for (llvm::Function *f : defs) setIsaLevel(*f, kIsaLevels[0]);
+
+    // the level of the CPU, as an index of kIsaLevels
+    llvm::LLVMContext &ctx = m.getContext();
+    llvm::Type *i32 = llvm::Type::getInt32Ty(ctx);
+    llvm::PointerType *ptr = llvm::PointerType::getUnqual(ctx);
+    llvm::Function *levelFn = nullptr;
+    auto isaLevel = [&]() {
+        if (levelFn) return levelFn;
+        // struct __processor_model { unsigned vendor, type, subtype;
+        //  unsigned features[1]; }
+        llvm::StructType *model = llvm::StructType::get(
+            ctx, {i32, i32, i32, llvm::ArrayType::get(i32, 1)});
+        llvm::Constant *cpuModel =
+            m.getOrInsertGlobal("__cpu_model", model);
+        llvm::FunctionCallee init = m.getOrInsertFunction(
+            "__cpu_indicator_init", llvm::Type::getVoidTy(ctx));
+        levelFn = llvm::Function::Create(
+            llvm::FunctionType::get(i32, false),
+            llvm::Function::InternalLinkage, "kaleidoscope.isa_level", &m);
+        setIsaLevel(*levelFn, kIsaLevels[0]);
+        llvm::IRBuilder<> b(llvm::BasicBlock::Create(ctx, "entry", levelFn));
+        b.CreateCall(init);
+        llvm::Value *features = b.CreateLoad(
+            i32, b.CreateInBoundsGEP(model, cpuModel,
+                                     {b.getInt32(0), b.getInt32(3),
+                                      b.getInt32(0)}));
+        llvm::Value *level = b.getInt32(0);
+        for (size_t l = 1; l != kLevels; ++l) {
+            llvm::Value *bits = b.getInt32(kIsaLevels[l].cpuFeatures);
+            level = b.CreateSelect(
+                b.CreateICmpEQ(b.CreateAnd(features, bits), bits),
+                b.getInt32(l), level);
+        }
+        b.CreateRet(level);
+        return levelFn;
+    };
+
+    for (size_t i = 0; i != defs.size(); ++i) {
+        llvm::Function *f = defs[i];
+        ++stats.functions;
+        if (f->hasLocalLinkage()) continue;
+        std::string name = f->getName().str();
+        f->setName(name + "." + kIsaLevels[0].suffix);
+        f->setLinkage(llvm::Function::InternalLinkage);
+
+        llvm::Function *resolver = llvm::Function::Create(
+            llvm::FunctionType::get(ptr, false),
+            llvm::Function::InternalLinkage, name + ".resolver", &m);
+        setIsaLevel(*resolver, kIsaLevels[0]);
+        llvm::IRBuilder<> b(llvm::BasicBlock::Create(ctx, "entry", resolver));
+        llvm::Value *level = b.CreateCall(isaLevel());
+        llvm::Value *chosen = versions[i][0];
+        for (size_t l = 1; l != kLevels; ++l)
+            chosen = b.CreateSelect(b.CreateICmpEQ(level, b.getInt32(l)),
+                                    versions[i][l], chosen);
+        b.CreateRet(chosen);
+        llvm::GlobalIFunc::create(f->getFunctionType(), 0,
+                                  llvm::GlobalValue::ExternalLinkage, name,
+                                  resolver, &m);
+        ++stats.dispatched;
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * File: whole_program.h
+ * Path: /aot/whole_program.h
+ * Module: aot
+ * Lang: C/C++
+ * Created Date: Thursday, October 22nd 2026, 6:03:47 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file optimizes the AOT module as a whole program before codegen.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <llvm-18/llvm/IR/GlobalValue.h>
+#include <llvm-18/llvm/IR/Module.h>
+#include <llvm-18/llvm/IR/PassManager.h>
+#include <llvm-18/llvm/Passes/OptimizationLevel.h>
+#include <llvm-18/llvm/Passes/PassBuilder.h>
+#include <llvm-18/llvm/Target/TargetMachine.h>
+#include <llvm-18/llvm/Transforms/IPO/GlobalDCE.h>
+#include <llvm-18/llvm/Transforms/IPO/Internalize.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+
+// -whole-program, for -stats
+struct WholeProgramStats {
+    size_t exported = 0;     // definitions left external
+    size_t internalized = 0; // made internal
+    size_t functions = 0;    // defined after the pipeline
+    double optSeconds = 0;
+    unsigned partitions = 0;
+    unsigned threads = 0;
+    double codegenSeconds = 0; // wall clock, over all the partitions
+    // codegen of the whole module on one thread, 0 if not measured
+    double serialSeconds = 0;
+
+    void print() const {
+        fprintf(stderr,
+                "whole-program: %zu definitions exported, %zu internalized, "
+                "%zu functions left after %.2f ms of optimization\n",
+                exported, internalized, functions, optSeconds * 1e3);
+        fprintf(stderr,
+                "whole-program: codegen of %u partitions on %u threads in "
+                "%.2f ms",
+                partitions, threads, codegenSeconds * 1e3);
+        if (serialSeconds > 0)
+            fprintf(stderr, ", %.2f ms on one thread, %.2fx speedup",
+                    serialSeconds * 1e3, serialSeconds / codegenSeconds);
+        fprintf(stderr, "\n");
+    }
+};
+
+// The link-time half of an LTO build, on a module that already is the
+//  whole program. Every definition that exported() rejects is made
+//  internal, so that once the IPO passes of the LTO pipeline have inlined
+//  it into its callers GlobalDCE drops it, and what is left is specialized
+//  without regard to outside callers. The driver has run the per-module
+//  pipeline at the end of the input; this plays the part of the linker's.
+//  At -O0 only internalization and GlobalDCE run.
+inline void
+optimizeWholeProgram(llvm::Module &m, llvm::TargetMachine *tm,
+                     unsigned optLevel,
+                     std::function<bool(const llvm::GlobalValue &)> exported,
+                     WholeProgramStats &stats) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (const llvm::Function &f : m)
+        if (!f.isDeclaration() && f.hasExternalLinkage())
+            ++(exported(f) ? stats.exported : stats.internalized);
+
+    // the vectorizers as in clang, from -O2 up, like OptPipeline
+    llvm::PipelineTuningOptions pto;
+    pto.LoopVectorization = optLevel > 1;
+    pto.SLPVectorization = optLevel > 1;
+    llvm::PassBuilder pb(tm, pto);
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+    pb.registerModuleAnalyses(mam);
+    pb.registerCGSCCAnalyses(cgam);
+    pb.registerFunctionAnalyses(fam);
+    pb.registerLoopAnalyses(lam);
+    pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+    llvm::ModulePassManager mpm;
+    mpm.addPass(llvm::InternalizePass(std::move(exported)));
+    mpm.addPass(llvm::GlobalDCEPass());
+    if (optLevel)
+        mpm.addPass(pb.buildLTODefaultPipeline(
+            optLevel == 1   ? llvm::OptimizationLevel::O1
+            : optLevel == 2 ? llvm::OptimizationLevel::O2
+                            : llvm::OptimizationLevel::O3,
+            nullptr));
+    mpm.run(m, mam);
+
+    for (const llvm::Function &f : m)
+        if (!f.isDeclaration()) ++stats.functions;
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    stats.optSeconds += dt.count();
+}
@@ -13,7 +13,11 @@
    /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
  */
 #pragma once
+#include "ast_arena.h"
 #include "expr_ast.h"
+#include "flat_ast.h"
+#include "flat_codegen.h"
+#include "flat_opt.h"
 #include "function_ast.h"
 #include "prototype_ast.h"
 #include "op_ast.h"
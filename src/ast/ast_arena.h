@@ -0,0 +1,105 @@
+/*
+ * File: ast_arena.h
+ * Path: /ast/ast_arena.h
+ * Module: ast
+ * Lang: C/C++
+ * Created Date: Saturday, October 17th 2026, 2:37:10 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A fixed-size array whose storage lives in an AstArena
+template <typename T> class ArenaArray {
+public:
+    ArenaArray() = default;
+    ArenaArray(T *data, size_t size) : data_(data), size_(size) {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T &operator[](size_t i) const { return data_[i]; }
+    T *begin() const { return data_; }
+    T *end() const { return data_ + size_; }
+
+private:
+    T *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Bump allocator that owns every expression node of one definition. Nodes are
+//  never destroyed one by one: the whole tree goes away with the arena, so
+//  everything allocated here must be trivially destructible.
+class AstArena {
+public:
+    AstArena() = default;
+    AstArena(const AstArena &) = delete;
+    AstArena &operator=(const AstArena &) = delete;
+
+    template <typename T, typename... Args> T *make(Args &&...args) {
+        static_assert(std::is_trivially_destructible_v<T>,
+                      "arena nodes are never destroyed");
+        ++nodes_;
+        return new (allocate(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    ArenaArray<T> copyArray(const T *first, const T *last) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        size_t n = last - first;
+        if (n == 0) return {};
+        ++arrays_;
+        T *data = static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+        std::uninitialized_copy(first, last, data);
+        return {data, n};
+    }
+
+    void *allocate(size_t size, size_t align) {
+        uintptr_t p = ((uintptr_t)cur_ + align - 1) & ~(uintptr_t)(align - 1);
+        if (cur_ == nullptr || p + size > (uintptr_t)end_) {
+            newSlab(size + align);
+            p = ((uintptr_t)cur_ + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cur_ = (char *)(p + size);
+        bytes_ += size;
+        return (void *)p;
+    }
+
+    // stats--------------------------------------------------------------
+    size_t nodes() const { return nodes_; }
+    size_t arrays() const { return arrays_; }
+    size_t bytes() const { return bytes_; }
+    size_t slabs() const { return slabs_.size(); }
+
+private:
+    // most definitions fit in the first slab, big ones grow geometrically
+    static constexpr size_t kFirstSlab = 1024;
+    static constexpr size_t kMaxSlab = 64 * 1024;
+
+    void newSlab(size_t atLeast) {
+        size_t size = slabs_.empty() ? kFirstSlab : nextSlab_;
+        if (nextSlab_ < kMaxSlab) nextSlab_ = size * 2;
+        if (size < atLeast) size = atLeast;
+        slabs_.push_back(std::make_unique<char[]>(size));
+        cur_ = slabs_.back().get();
+        end_ = cur_ + size;
+    }
+
+    std::vector<std::unique_ptr<char[]>> slabs_;
+    char *cur_ = nullptr;
+    char *end_ = nullptr;
+    size_t nextSlab_ = kFirstSlab * 2;
+    size_t nodes_ = 0, arrays_ = 0, bytes_ = 0;
+};
@@ -13,9 +13,13 @@
    /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
  */
 #pragma once
+#include "ast_arena.h"
 #include "compiler_type.h"
+#include "flat_ast.h"
+#include "interner.h"
 #include "logger.h"
 #include <llvm-18/llvm/ADT/APFloat.h>
+
 #include <llvm-18/llvm/IR/BasicBlock.h>
 #include <llvm-18/llvm/IR/Constants.h>
 #include <llvm-18/llvm/IR/Function.h>
@@ -23,18 +27,53 @@
 #include <llvm-18/llvm/IR/Instructions.h>
 #include <llvm-18/llvm/IR/LLVMContext.h>
 #include <llvm-18/llvm/IR/Value.h>
-#include <memory>
+#include <vector>
 
 // template <CompilerType CT> class Parser;
 template <CompilerType CT> class ParserEnv;
 
-// Base class for AST node
+// Base class for AST node. Nodes live in the AstArena of their definition and
+//  are released with it, never one by one, so there is no virtual destructor
 template <CompilerType CT> class ExprAST {
 public:
     ExprAST(ParserEnv<CT> *env) : env_(env) {}
-    virtual ~ExprAST() = default;
     virtual llvm::Value *codegen() = 0;
 
+    // the children in their flat order; a missing one is nullptr
+    virtual unsigned numKids() const { return 0; }
+    virtual ExprAST<CT> *kid(unsigned) const { return nullptr; }
+    // append this node to out, given the flat indices of its children
+    virtual uint32_t flattenNode(FlatExpr &out, const uint32_t *kids) const = 0;
+
+    // Append this subtree to out in post-order, returns the index of its
+    //  root. Walks with an explicit stack, so any depth is fine.
+    uint32_t flatten(FlatExpr &out) const {
+        struct Pending {
+            const ExprAST<CT> *node;
+            unsigned next;    // next child to flatten
+            size_t kidsBegin; // its children's indices start here in kids
+        };
+        std::vector<Pending> stack{{this, 0, 0}};
+        std::vector<uint32_t> kids;
+        uint32_t idx = kNoNode;
+        while (!stack.empty()) {
+            Pending &top = stack.back();
+            if (top.next != top.node->numKids()) {
+                ExprAST<CT> *k = top.node->kid(top.next++);
+                if (k)
+                    stack.push_back({k, 0, kids.size()});
+                else
+                    kids.push_back(kNoNode);
+                continue;
+            }
+            idx = top.node->flattenNode(out, kids.data() + top.kidsBegin);
+            kids.resize(top.kidsBegin);
+            stack.pop_back();
+            kids.push_back(idx);
+        }
+        return idx;
+    }
+
 protected:
     ParserEnv<CT> *env_;
 };
@@ -48,6 +87,9 @@ public:
         return llvm::ConstantFP::get(*(this->env_->getContext()),
                                      llvm::APFloat(this->val_));
     }
+    uint32_t flattenNode(FlatExpr &out, const uint32_t *) const override {
+        return out.addNumber(val_);
+    }
 
 private:
     double val_;
@@ -56,26 +98,28 @@ private:
 // Expression class for variable
 template <CompilerType CT> class VariableExprAST : public ExprAST<CT> {
 public:
-    VariableExprAST(const std::string &name, ParserEnv<CT> *env)
+    VariableExprAST(SymbolId name, ParserEnv<CT> *env)
         : ExprAST<CT>(env), name_(name) {}
     llvm::Value *codegen() override {
         llvm::Value *V = this->env_->getValue(this->name_);
         if (!V) LogErrorV<CT>("unknown variable name");
         return V;
     }
+    uint32_t flattenNode(FlatExpr &out, const uint32_t *) const override {
+        return out.addVariable(name_);
+    }
 
 private:
-    std::string name_;
+    SymbolId name_;
 };
 
 // CallExprAST=========================================================================
 // Expression class for binary operator
 template <CompilerType CT> class BinaryExprAST : public ExprAST<CT> {
 public:
-    BinaryExprAST(char op, std::unique_ptr<ExprAST<CT>> LHS,
-                  std::unique_ptr<ExprAST<CT>> RHS, ParserEnv<CT> *env)
-        : ExprAST<CT>(env), op_(op), lhs_(std::move(LHS)),
-          rhs_(std::move(RHS)) {}
+    BinaryExprAST(char op, ExprAST<CT> *LHS, ExprAST<CT> *RHS,
+                  ParserEnv<CT> *env)
+        : ExprAST<CT>(env), op_(op), lhs_(LHS), rhs_(RHS) {}
     llvm::Value *codegen() override {
         llvm::Value *l = this->lhs_->codegen();
         llvm::Value *r = this->rhs_->codegen();
@@ -103,33 +147,33 @@ public:
 
         // check if the op is user-defined
         llvm::Function *f =
-            this->env_->getFunction(std::string("binary") + op_);
+            this->env_->getFunction(Interner::global().binaryOp(op_));
         assert(f && "invalid binary op (undefined)");
 
         llvm::Value *ops[2] = {l, r};
         return this->env_->getBuilder()->CreateCall(f, ops, "binop");
     }
+    unsigned numKids() const override { return 2; }
+    ExprAST<CT> *kid(unsigned i) const override { return i ? rhs_ : lhs_; }
+    uint32_t flattenNode(FlatExpr &out, const uint32_t *kids) const override {
+        return out.addBinary(op_, kids[0], kids[1]);
+    }
 
 private:
     char op_;
-    std::unique_ptr<ExprAST<CT>> lhs_, rhs_;
+    ExprAST<CT> *lhs_, *rhs_;
 };
 
 // Expression class for function calls
 template <CompilerType CT> class CallExprAST : public ExprAST<CT> {
 public:
-    CallExprAST(const std::string &callee,
-                std::vector<std::unique_ptr<ExprAST<CT>>> args,
+    CallExprAST(SymbolId callee, ArenaArray<ExprAST<CT> *> args,
                 ParserEnv<CT> *env)
-        : ExprAST<CT>(env), callee_(callee), args_(std::move(args)) {}
+        : ExprAST<CT>(env), callee_(callee), args_(args) {}
 
     llvm::Value *codegen() override {
-        llvm::Function *calleeF;
-        if constexpr (CT == CompilerType::AOT) {
-            calleeF = this->env_->getModule()->getFunction(this->callee_);
-        } else if constexpr (CT == CompilerType::JIT) {
-            calleeF = this->env_->getFunction(this->callee_);
-        }
+        // see FlatCodegen::stepCall()
+        llvm::Function *calleeF = this->env_->getFunction(this->callee_);
 
         if (!calleeF) return LogErrorV<CT>("unknown function referenced");
         if (calleeF->arg_size() != this->args_.size())
@@ -143,25 +187,27 @@ public:
 
         return this->env_->getBuilder()->CreateCall(calleeF, argsV, "calltmp");
     }
+    unsigned numKids() const override { return args_.size(); }
+    ExprAST<CT> *kid(unsigned i) const override { return args_[i]; }
+    uint32_t flattenNode(FlatExpr &out, const uint32_t *kids) const override {
+        return out.addCall(callee_, kids, (uint32_t)args_.size());
+    }
 
 private:
-    std::string callee_;
-    std::vector<std::unique_ptr<ExprAST<CT>>> args_;
+    SymbolId callee_;
+    ArenaArray<ExprAST<CT> *> args_;
 };
 
 template <CompilerType CT> class IfExprAST : public ExprAST<CT> {
 public:
-    IfExprAST(std::unique_ptr<ExprAST<CT>> condp,
-              std::unique_ptr<ExprAST<CT>> thenp, ParserEnv<CT> *env)
-        : ExprAST<CT>(env), cond_(std::move(condp)), then_(std::move(thenp)) {
+    IfExprAST(ExprAST<CT> *condp, ExprAST<CT> *thenp, ParserEnv<CT> *env)
+        : ExprAST<CT>(env), cond_(condp), then_(thenp) {
         else_ = nullptr;
     }
 
-    IfExprAST(std::unique_ptr<ExprAST<CT>> condp,
-              std::unique_ptr<ExprAST<CT>> thenp,
-              std::unique_ptr<ExprAST<CT>> elsep, ParserEnv<CT> *env)
-        : ExprAST<CT>(env), cond_(std::move(condp)), then_(std::move(thenp)),
-          else_(std::move(elsep)) {}
+    IfExprAST(ExprAST<CT> *condp, ExprAST<CT> *thenp, ExprAST<CT> *elsep,
+              ParserEnv<CT> *env)
+        : ExprAST<CT>(env), cond_(condp), then_(thenp), else_(elsep) {}
 
     llvm::Value *codegen() override {
         // We are creating a struction like: Funciton-BBlock-code
@@ -228,20 +274,24 @@ public:
 
         return pn;
     }
+    unsigned numKids() const override { return 3; }
+    ExprAST<CT> *kid(unsigned i) const override {
+        return i == 0 ? cond_ : i == 1 ? then_ : else_;
+    }
+    uint32_t flattenNode(FlatExpr &out, const uint32_t *kids) const override {
+        return out.addIf(kids[0], kids[1], kids[2]);
+    }
 
 private:
-    std::unique_ptr<ExprAST<CT>> cond_, then_, else_;
+    ExprAST<CT> *cond_, *then_, *else_;
 };
 
 template <CompilerType CT> class ForExprAST : public ExprAST<CT> {
 public:
-    ForExprAST(const std::string &varName, std::unique_ptr<ExprAST<CT>> start,
-               std::unique_ptr<ExprAST<CT>> end,
-               std::unique_ptr<ExprAST<CT>> step,
-               std::unique_ptr<ExprAST<CT>> body, ParserEnv<CT> *env)
-        : ExprAST<CT>(env), varName_(varName), start_(std::move(start)),
-          end_(std::move(end)), step_(std::move(step)), body_(std::move(body)) {
-    }
+    ForExprAST(SymbolId varName, ExprAST<CT> *start, ExprAST<CT> *end,
+               ExprAST<CT> *step, ExprAST<CT> *body, ParserEnv<CT> *env)
+        : ExprAST<CT>(env), varName_(varName), start_(start), end_(end),
+          step_(step), body_(body) {}
 
     // The whole loop body is one block, but remember that the body code itself
     //  could consist of multiple blocks
@@ -265,13 +315,14 @@ public:
 
         // Start the PHI node with an entry for Start. The “preheader” for the
         //  loop is set up
-        llvm::PHINode *variable = curBuilder->CreatePHI(
-            llvm::Type::getDoubleTy(*curContext), 2, varName_);
+        llvm::PHINode *variable =
+            curBuilder->CreatePHI(llvm::Type::getDoubleTy(*curContext), 2,
+                                  Interner::global().str(varName_));
         variable->addIncoming(startVal, preheaderBB);
 
-        // within the loop, the variable is defined equal to the PHI node. If it
-        //  shadows an existing variable, we have to restore it, so save it now.
-        llvm::Value *oldVal = this->env_->getValue(varName_); // local var
+        // within the loop, the variable is defined equal to the PHI node. It
+        //  may shadow an existing variable until the loop's scope is popped
+        this->env_->pushScope();
         this->env_->setValue(varName_, variable);
         // emit the body of the loop. like any other expr, this can change the
         //  current BB. We ignore the value computed by the body, but don't
@@ -311,39 +362,48 @@ public:
         // add a new entry to the phi node for the backedge
         variable->addIncoming(nextVar, loopEndBB);
         // restore the unshadowed var
-        if (oldVal)
-            this->env_->setValue(varName_, oldVal);
-        else
-            this->env_->rmValue(varName_);
+        this->env_->popScope();
         // for expr always returns 0.0
         return llvm::Constant::getNullValue(
             llvm::Type::getDoubleTy(*curContext));
     }
+    unsigned numKids() const override { return 4; }
+    ExprAST<CT> *kid(unsigned i) const override {
+        ExprAST<CT> *kids[4] = {start_, end_, step_, body_};
+        return kids[i];
+    }
+    uint32_t flattenNode(FlatExpr &out, const uint32_t *kids) const override {
+        return out.addFor(varName_, kids[0], kids[1], kids[2], kids[3]);
+    }
 
 private:
-    std::string varName_;
-    std::unique_ptr<ExprAST<CT>> start_, end_, step_, body_;
+    SymbolId varName_;
+    ExprAST<CT> *start_, *end_, *step_, *body_;
 };
 
 template <CompilerType CT> class UnaryExprAST : public ExprAST<CT> {
 
 public:
-    UnaryExprAST(char opcode, std::unique_ptr<ExprAST<CT>> operand,
-                 ParserEnv<CT> *env)
-        : ExprAST<CT>(env), opCode_(opcode), operand_(std::move(operand)) {}
+    UnaryExprAST(char opcode, ExprAST<CT> *operand, ParserEnv<CT> *env)
+        : ExprAST<CT>(env), opCode_(opcode), operand_(operand) {}
 
     llvm::Value *codegen() override {
         llvm::Value *operandv = operand_->codegen();
         if (!operandv) return nullptr;
         llvm::Function *f =
-            this->env_->getFunction(std::string("unary") + opCode_);
+            this->env_->getFunction(Interner::global().unaryOp(opCode_));
         if (!f) return LogErrorV<CT>("unknown unary operator");
 
         return this->env_->getBuilder()->CreateCall(f, operandv, "unop");
 
     }
+    unsigned numKids() const override { return 1; }
+    ExprAST<CT> *kid(unsigned) const override { return operand_; }
+    uint32_t flattenNode(FlatExpr &out, const uint32_t *kids) const override {
+        return out.addUnary(opCode_, kids[0]);
+    }
 
 protected:
     char opCode_;
-    std::unique_ptr<ExprAST<CT>> operand_;
+    ExprAST<CT> *operand_;
 };
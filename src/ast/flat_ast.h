@@ -0,0 +1,139 @@
+/*
+ * File: flat_ast.h
+ * Path: /ast/flat_ast.h
+ * Module: ast
+ * Lang: C/C++
+ * Created Date: Saturday, October 17th 2026, 4:12:27 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file defines the flat, index based encoding of an expression.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "interner.h"
+#include <cstdint>
+#include <vector>
+
+enum class FlatKind : uint8_t { Number, Variable, Binary, Unary, Call, If, For };
+
+// index of a missing child (if without else, for without step)
+constexpr uint32_t kNoNode = ~(uint32_t)0;
+
+// One expression node, 32 bytes. Which fields are used depends on kind:
+//  Number    num
+//  Variable  sym
+//  Binary    op, kids = {lhs, rhs}
+//  Unary     op, kids = {operand}
+//  Call      sym (callee), kids = {first arg in FlatExpr::args, #args}
+//  If        kids = {cond, then, else}
+//  For       sym (loop variable), kids = {start, end, step, body}
+struct FlatNode {
+    FlatKind kind;
+    char op;
+    SymbolId sym;
+    uint32_t kids[4];
+    double num;
+};
+static_assert(sizeof(FlatNode) == 32, "keep two nodes per cache line");
+
+// An expression as one contiguous node array. Children are always added
+//  before their parent, so the array is in post-order, the root is the last
+//  node and a pass that only cares about data flow (folding, printing,
+//  serialization) can walk it front to back without recursion.
+class FlatExpr {
+public:
+    uint32_t addNumber(double val) {
+        FlatNode n = node(FlatKind::Number);
+        n.num = val;
+        return push(n);
+    }
+
+    uint32_t addVariable(SymbolId name) {
+        FlatNode n = node(FlatKind::Variable);
+        n.sym = name;
+        return push(n);
+    }
+
+    uint32_t addBinary(char op, uint32_t lhs, uint32_t rhs) {
+        FlatNode n = node(FlatKind::Binary);
+        n.op = op;
+        n.kids[0] = lhs;
+        n.kids[1] = rhs;
+        return push(n);
+    }
+
+    uint32_t addUnary(char op, uint32_t operand) {
+        FlatNode n = node(FlatKind::Unary);
+        n.op = op;
+        n.kids[0] = operand;
+        return push(n);
+    }
+
+    uint32_t addCall(SymbolId callee, const uint32_t *args, uint32_t numArgs) {
+        FlatNode n = node(FlatKind::Call);
+        n.sym = callee;
+        n.kids[0] = (uint32_t)args_.size();
+        n.kids[1] = numArgs;
+        args_.insert(args_.end(), args, args + numArgs);
+        return push(n);
+    }
+
+    uint32_t addIf(uint32_t cond, uint32_t then, uint32_t otherwise) {
+        FlatNode n = node(FlatKind::If);
+        n.kids[0] = cond;
+        n.kids[1] = then;
+        n.kids[2] = otherwise;
+        return push(n);
+    }
+
+    uint32_t addFor(SymbolId var, uint32_t start, uint32_t end, uint32_t step,
+                    uint32_t body) {
+        FlatNode n = node(FlatKind::For);
+        n.sym = var;
+        n.kids[0] = start;
+        n.kids[1] = end;
+        n.kids[2] = step;
+        n.kids[3] = body;
+        return push(n);
+    }
+
+    const FlatNode &operator[](uint32_t i) const { return nodes_[i]; }
+    uint32_t size() const { return (uint32_t)nodes_.size(); }
+    bool empty() const { return nodes_.empty(); }
+    uint32_t root() const { return size() - 1; }
+
+    const std::vector<FlatNode> &nodes() const { return nodes_; }
+
+    // the argument node indices of a Call
+    const uint32_t *args(const FlatNode &call) const {
+        return args_.data() + call.kids[0];
+    }
+    uint32_t numArgs(const FlatNode &call) const { return call.kids[1]; }
+
+    size_t bytes() const {
+        return nodes_.size() * sizeof(FlatNode) +
+               args_.size() * sizeof(uint32_t);
+    }
+
+    void clear() {
+        nodes_.clear();
+        args_.clear();
+    }
+
+private:
+    static FlatNode node(FlatKind kind) {
+        return {kind, 0, kNoSymbol, {kNoNode, kNoNode, kNoNode, kNoNode}, 0.0};
+    }
+
+    uint32_t push(const FlatNode &n) {
+        nodes_.push_back(n);
+        return (uint32_t)nodes_.size() - 1;
+    }
+
+    std::vector<FlatNode> nodes_;
+    std::vector<uint32_t> args_;
+};
@@ -0,0 +1,349 @@
+/*
+ * File: flat_codegen.h
+ * Path: /ast/flat_codegen.h
+ * Module: ast
+ * Lang: C/C++
+ * Created Date: Saturday, October 17th 2026, 4:48:03 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file generates LLVM IR from a FlatExpr.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "compiler_type.h"
+#include "flat_ast.h"
+#include "interner.h"
+#include "logger.h"
+#include <llvm-18/llvm/ADT/APFloat.h>
+#include <llvm-18/llvm/ADT/SmallVector.h>
+#include <llvm-18/llvm/IR/BasicBlock.h>
+#include <llvm-18/llvm/IR/Constants.h>
+#include <llvm-18/llvm/IR/Function.h>
+#include <llvm-18/llvm/IR/IRBuilder.h>
+#include <llvm-18/llvm/IR/Instructions.h>
+#include <llvm-18/llvm/IR/Value.h>
+#include <cassert>
+#include <vector>
+
+template <CompilerType CT> class ParserEnv;
+
+// Emits the same IR as ExprAST<CT>::codegen(), but from the node array of a
+//  FlatExpr: one switch on the node kind instead of a virtual call per node,
+//  and children are read from the same contiguous array.
+//
+// The walk keeps its own stack of nodes in progress instead of recursing,
+//  so arbitrarily deep expressions only cost heap. A node that needs a child
+//  value returns that child's index from step(); once the child is done its
+//  value comes back to the parent in ret, and the parent resumes at the
+//  stage it was left in.
+//
+// After FlatOptimizer the expression may be a DAG. The value of a node is
+//  remembered together with the region it was emitted in, where a region is
+//  the body of the function, of an if branch or of a loop. Another use of
+//  the node reuses that value only while the region is still open, as the
+//  value then dominates the use, and not across a loop boundary, where the
+//  loop variable may shadow the variable the value was computed from.
+//  Anywhere else the node is emitted again.
+template <CompilerType CT> class FlatCodegen {
+public:
+    FlatCodegen(const FlatExpr &expr, ParserEnv<CT> *env)
+        : expr_(expr), env_(env), builder_(env->getBuilder()),
+          context_(env->getContext()),
+          doubleTy_(llvm::Type::getDoubleTy(*context_)) {}
+
+    // On error the whole expression fails with the first error, there is
+    //  nothing useful to emit after it
+    llvm::Value *codegen() {
+        stack_.clear();
+        memo_.assign(expr_.size(), {nullptr, 0});
+        open_.clear();
+        regions_.clear();
+        barrier_ = 0;
+        enterRegion(false);
+        stack_.push_back({expr_.root()});
+        llvm::Value *ret = nullptr;
+        while (!stack_.empty()) {
+            uint32_t next = step(stack_.back(), ret);
+            if (next == kFail) return nullptr;
+            if (next == kDone) {
+                memo_[stack_.back().idx] = {ret, regions_.back().id};
+                stack_.pop_back();
+            } else if (llvm::Value *known = lookup(next)) {
+                ret = known; // and resume the parent
+            } else {
+                stack_.push_back({next});
+            }
+        }
+        return ret;
+    }
+
+private:
+    static constexpr uint32_t kDone = kNoNode;
+    static constexpr uint32_t kFail = kNoNode - 1;
+
+    struct Frame {
+        uint32_t idx;
+        uint32_t stage = 0;
+        // values and blocks kept between the stages of a node
+        llvm::Value *vals[2] = {nullptr, nullptr};
+        llvm::BasicBlock *blocks[3] = {nullptr, nullptr, nullptr};
+        llvm::Function *callee = nullptr;
+        size_t argsBegin = 0;
+    };
+
+    struct Memo {
+        llvm::Value *val;
+        uint32_t region;
+    };
+
+    struct Region {
+        uint32_t id;
+        uint32_t savedBarrier;
+    };
+
+    void enterRegion(bool loop) {
+        uint32_t id = (uint32_t)open_.size();
+        open_.push_back(1);
+        regions_.push_back({id, barrier_});
+        if (loop) barrier_ = id;
+    }
+
+    void exitRegion() {
+        open_[regions_.back().id] = 0;
+        barrier_ = regions_.back().savedBarrier;
+        regions_.pop_back();
+    }
+
+    // regions are numbered in the order they open, so the open ones at or
+    //  above the barrier are the innermost loop body and what it encloses
+    llvm::Value *lookup(uint32_t idx) const {
+        const Memo &m = memo_[idx];
+        return m.val && open_[m.region] && m.region >= barrier_ ? m.val
+                                                                : nullptr;
+    }
+
+    llvm::Value *constant(double v) {
+        return llvm::ConstantFP::get(*context_, llvm::APFloat(v));
+    }
+
+    // Advance the node of f. ret is the value of the child it asked for
+    //  last; when the node is done, ret is set to its value.
+    //  Returns the next child to emit, kDone or kFail.
+    uint32_t step(Frame &f, llvm::Value *&ret) {
+        const FlatNode &n = expr_[f.idx];
+        if (f.stage != 0 && !ret) return kFail;
+
+        switch (n.kind) {
+        case FlatKind::Number:
+            ret = constant(n.num);
+            return kDone;
+        case FlatKind::Variable:
+            ret = env_->getValue(n.sym);
+            if (!ret) LogErrorV<CT>("unknown variable name");
+            return ret ? kDone : kFail;
+        case FlatKind::Binary:
+            if (f.stage++ == 0) return n.kids[0];
+            if (f.stage == 2) {
+                f.vals[0] = ret;
+                return n.kids[1];
+            }
+            ret = emitBinary(n.op, f.vals[0], ret);
+            return kDone;
+        case FlatKind::Unary:
+            if (f.stage++ == 0) return n.kids[0];
+            ret = emitUnary(n.op, ret);
+            return ret ? kDone : kFail;
+        case FlatKind::Call:
+            return stepCall(f, n, ret);
+        case FlatKind::If:
+            return stepIf(f, n, ret);
+        case FlatKind::For:
+            return stepFor(f, n, ret);
+        }
+        return kFail;
+    }
+
+    llvm::Value *emitBinary(char op, llvm::Value *l, llvm::Value *r) {
+        switch (op) {
+        case '+':
+            return builder_->CreateFAdd(l, r, "addtmp");
+        case '-':
+            return builder_->CreateFSub(l, r, "subtmp");
+        case '*':
+            return builder_->CreateFMul(l, r, "multmp");
+        case '<':
+            l = builder_->CreateFCmpULT(l, r, "cmptmp");
+            return builder_->CreateUIToFP(l, doubleTy_, "booltmp");
+        default:
+            break;
+        }
+
+        // user-defined operator
+        llvm::Function *f = env_->getFunction(Interner::global().binaryOp(op));
+        assert(f && "invalid binary op (undefined)");
+        llvm::Value *ops[2] = {l, r};
+        return builder_->CreateCall(f, ops, "binop");
+    }
+
+    llvm::Value *emitUnary(char op, llvm::Value *operand) {
+        llvm::Function *f = env_->getFunction(Interner::global().unaryOp(op));
+        if (!f) return LogErrorV<CT>("unknown unary operator");
+        return builder_->CreateCall(f, operand, "unop");
+    }
+
+    uint32_t stepCall(Frame &f, const FlatNode &n, llvm::Value *&ret) {
+        uint32_t numArgs = expr_.numArgs(n);
+        if (f.stage == 0) {
+            // the module first; the AOT env knows prototypes only with
+            //  -incremental, which compiles each def in a module of its own
+            f.callee = env_->getFunction(n.sym);
+            if (!f.callee) {
+                LogErrorV<CT>("unknown function referenced");
+                return kFail;
+            }
+            if (f.callee->arg_size() != numArgs) {
+                LogErrorV<CT>("incorrect number of args passed");
+                return kFail;
+            }
+            f.argsBegin = argVals_.size();
+        } else {
+            argVals_.push_back(ret);
+        }
+        if (f.stage != numArgs) return expr_.args(n)[f.stage++];
+
+        ret = builder_->CreateCall(
+            f.callee,
+            llvm::ArrayRef<llvm::Value *>(argVals_).drop_front(f.argsBegin),
+            "calltmp");
+        argVals_.resize(f.argsBegin);
+        return kDone;
+    }
+
+    // same block structure as IfExprAST::codegen()
+    uint32_t stepIf(Frame &f, const FlatNode &n, llvm::Value *&ret) {
+        llvm::BasicBlock *&thenBB = f.blocks[0];
+        llvm::BasicBlock *&elseBB = f.blocks[1];
+        llvm::BasicBlock *&mergeBB = f.blocks[2];
+        switch (f.stage++) {
+        case 0:
+            return n.kids[0];
+        case 1: {
+            llvm::Value *condV = builder_->CreateFCmpONE(ret, constant(0.0));
+            llvm::Function *theFunction =
+                builder_->GetInsertBlock()->getParent();
+            thenBB = llvm::BasicBlock::Create(*context_, "then", theFunction);
+            elseBB = llvm::BasicBlock::Create(*context_, "else");
+            mergeBB = llvm::BasicBlock::Create(*context_, "ifcont");
+            builder_->CreateCondBr(condV, thenBB, elseBB);
+            builder_->SetInsertPoint(thenBB);
+            enterRegion(false);
+            return n.kids[1];
+        }
+        case 2: {
+            exitRegion();
+            f.vals[0] = ret;
+            builder_->CreateBr(mergeBB);
+            thenBB = builder_->GetInsertBlock();
+
+            llvm::Function *theFunction = thenBB->getParent();
+            theFunction->insert(theFunction->end(), elseBB);
+            builder_->SetInsertPoint(elseBB);
+            if (n.kids[2] != kNoNode) {
+                enterRegion(false);
+                return n.kids[2];
+            }
+            ret = constant(0.0);
+            [[fallthrough]];
+        }
+        default: {
+            if (n.kids[2] != kNoNode) exitRegion();
+            builder_->CreateBr(mergeBB);
+            elseBB = builder_->GetInsertBlock();
+
+            llvm::Function *theFunction = elseBB->getParent();
+            theFunction->insert(theFunction->end(), mergeBB);
+            builder_->SetInsertPoint(mergeBB);
+            llvm::PHINode *pn = builder_->CreatePHI(doubleTy_, 2, "iftmp");
+            pn->addIncoming(f.vals[0], thenBB);
+            pn->addIncoming(ret, elseBB);
+            ret = pn;
+            return kDone;
+        }
+        }
+    }
+
+    // same block structure as ForExprAST::codegen(); the body is emitted
+    //  before the step and the end condition
+    uint32_t stepFor(Frame &f, const FlatNode &n, llvm::Value *&ret) {
+        llvm::Value *&variable = f.vals[0];
+        llvm::Value *&nextVar = f.vals[1];
+        switch (f.stage++) {
+        case 0:
+            return n.kids[0]; // start
+        case 1: {
+            llvm::BasicBlock *preheaderBB = builder_->GetInsertBlock();
+            llvm::BasicBlock *loopBB = llvm::BasicBlock::Create(
+                *context_, "loop", preheaderBB->getParent());
+            builder_->CreateBr(loopBB);
+            builder_->SetInsertPoint(loopBB);
+
+            llvm::PHINode *phi = builder_->CreatePHI(
+                doubleTy_, 2, Interner::global().str(n.sym));
+            phi->addIncoming(ret, preheaderBB);
+            variable = phi;
+            f.blocks[0] = loopBB;
+
+            // the loop variable shadows an outer one until the loop ends
+            env_->pushScope();
+            env_->setValue(n.sym, variable);
+            enterRegion(true);
+            return n.kids[3]; // body
+        }
+        case 2:
+            if (n.kids[2] != kNoNode) return n.kids[2]; // step
+            ret = constant(1.0);
+            ++f.stage;
+            [[fallthrough]];
+        case 3:
+            nextVar = builder_->CreateFAdd(variable, ret, "nextVar");
+            return n.kids[1]; // end
+        default: {
+            exitRegion();
+            llvm::Value *endCond =
+                builder_->CreateFCmpONE(ret, constant(0.0), "loopcond");
+
+            llvm::BasicBlock *loopEndBB = builder_->GetInsertBlock();
+            llvm::BasicBlock *afterBB = llvm::BasicBlock::Create(
+                *context_, "afterloop", loopEndBB->getParent());
+            builder_->CreateCondBr(endCond, f.blocks[0], afterBB);
+            builder_->SetInsertPoint(afterBB);
+
+            llvm::cast<llvm::PHINode>(variable)->addIncoming(nextVar,
+                                                             loopEndBB);
+            env_->popScope();
+            ret = llvm::Constant::getNullValue(doubleTy_);
+            return kDone;
+        }
+        }
+    }
+
+    const FlatExpr &expr_;
+    ParserEnv<CT> *env_;
+    llvm::IRBuilder<> *builder_;
+    llvm::LLVMContext *context_;
+    llvm::Type *doubleTy_;
+    std::vector<Frame> stack_;
+    // argument values of the calls in progress, innermost last
+    std::vector<llvm::Value *> argVals_;
+    // per node, its value and the region it was emitted in
+    std::vector<Memo> memo_;
+    // per region id, whether it is still open
+    std::vector<uint8_t> open_;
+    std::vector<Region> regions_;
+    // id of the innermost open loop body region
+    uint32_t barrier_ = 0;
+};
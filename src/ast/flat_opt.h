@@ -0,0 +1,292 @@
+/*
+ * File: flat_opt.h
+ * Path: /ast/flat_opt.h
+ * Module: ast
+ * Lang: C/C++
+ * Created Date: Sunday, October 18th 2026, 11:36:52 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file simplifies a FlatExpr before codegen.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "flat_ast.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// What FlatOptimizer did, summed over definitions for -stats
+struct FlatOptStats {
+    size_t nodesIn = 0;
+    size_t nodesOut = 0;
+    size_t folded = 0;     // operators on constants replaced by their value
+    size_t simplified = 0; // identities
+    size_t shared = 0;     // nodes merged into an identical earlier one
+
+    FlatOptStats &operator+=(const FlatOptStats &o) {
+        nodesIn += o.nodesIn;
+        nodesOut += o.nodesOut;
+        folded += o.folded;
+        simplified += o.simplified;
+        shared += o.shared;
+        return *this;
+    }
+};
+
+// One forward pass over the post-order node array that rebuilds it:
+//  - the built-in operators + - * < on two constants are folded, with the
+//    same double arithmetic the emitted IR would do;
+//  - x*1, 1*x, x-0, x+(-0) become x (only identities exact for every
+//    double, x+0 is not one as -0+0 is +0);
+//  - pure subtrees (constants, variables and built-in operators on pure
+//    operands) are hash-consed, so identical ones become a single node and
+//    the expression a DAG. Calls and user operators may have side effects
+//    and are never merged.
+//  The constants left unused by folding are dropped by a final compaction.
+//  Nothing that could report an error at codegen (an unknown variable or
+//  function) is ever removed, so an if with a constant condition keeps both
+//  branches and is left to LLVM. FlatCodegen emits a shared node once per
+//  region it is valid in, see FlatCodegen::codegen().
+class FlatOptimizer {
+public:
+    explicit FlatOptimizer(FlatOptStats &stats) : stats_(stats) {}
+
+    void run(FlatExpr &expr) {
+        if (expr.empty()) return;
+        stats_.nodesIn += expr.size();
+        FlatExpr out;
+        map_.assign(expr.size(), kNoNode);
+        pure_.clear();
+        consed_.clear();
+        for (uint32_t i = 0; i != expr.size(); ++i)
+            map_[i] = rewrite(expr, expr[i], out);
+        uint32_t root = map_[expr.root()];
+        expr = compact(out, root);
+        stats_.nodesOut += expr.size();
+    }
+
+private:
+    struct Key {
+        FlatKind kind;
+        char op;
+        SymbolId sym;
+        uint32_t lhs, rhs;
+        uint64_t bits; // of a Number, so -0.0 and 0.0 stay apart
+
+        bool operator==(const Key &o) const {
+            return kind == o.kind && op == o.op && sym == o.sym &&
+                   lhs == o.lhs && rhs == o.rhs && bits == o.bits;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &k) const {
+            uint64_t h = (uint64_t)k.kind << 8 | (uint8_t)k.op;
+            for (uint64_t v : {(uint64_t)k.sym, (uint64_t)k.lhs,
+                               (uint64_t)k.rhs, k.bits})
+                h = (h ^ v) * 0x100000001b3ull;
+            return (size_t)(h ^ h >> 32);
+        }
+    };
+
+    static bool isBuiltin(char op) {
+        return op == '+' || op == '-' || op == '*' || op == '<';
+    }
+
+    static bool isNumber(const FlatExpr &e, uint32_t i, double val) {
+        return e[i].kind == FlatKind::Number &&
+               std::memcmp(&e[i].num, &val, sizeof val) == 0;
+    }
+
+    static uint32_t mapKid(const std::vector<uint32_t> &map, uint32_t k) {
+        return k == kNoNode ? kNoNode : map[k];
+    }
+
+    // hash-conses a pure node; the fields that do not apply to its kind are
+    //  left at their defaults
+    uint32_t intern(FlatExpr &out, const Key &key) {
+        auto found = consed_.find(key);
+        if (found != consed_.end()) {
+            ++stats_.shared;
+            return found->second;
+        }
+        uint32_t idx;
+        switch (key.kind) {
+        case FlatKind::Number: {
+            double val;
+            std::memcpy(&val, &key.bits, sizeof val);
+            idx = out.addNumber(val);
+            break;
+        }
+        case FlatKind::Variable:
+            idx = out.addVariable(key.sym);
+            break;
+        default:
+            idx = out.addBinary(key.op, key.lhs, key.rhs);
+            break;
+        }
+        consed_.emplace(key, idx);
+        setPure(idx, true);
+        return idx;
+    }
+
+    uint32_t number(FlatExpr &out, double val) {
+        Key key{FlatKind::Number, 0, kNoSymbol, kNoNode, kNoNode, 0};
+        std::memcpy(&key.bits, &val, sizeof val);
+        return intern(out, key);
+    }
+
+    uint32_t impure(uint32_t idx) {
+        setPure(idx, false);
+        return idx;
+    }
+
+    void setPure(uint32_t idx, bool pure) {
+        if (pure_.size() <= idx) pure_.resize(idx + 1);
+        pure_[idx] = pure;
+    }
+
+    // appends the rewritten n to out, or returns an existing node it
+    //  equals; its children are already in out
+    uint32_t rewrite(const FlatExpr &in, const FlatNode &n, FlatExpr &out) {
+        switch (n.kind) {
+        case FlatKind::Number:
+            return number(out, n.num);
+        case FlatKind::Variable:
+            return intern(out, {FlatKind::Variable, 0, n.sym, kNoNode,
+                                kNoNode, 0});
+        case FlatKind::Binary:
+            return rewriteBinary(n, out);
+        case FlatKind::Unary:
+            return impure(out.addUnary(n.op, map_[n.kids[0]]));
+        case FlatKind::Call: {
+            args_.clear();
+            const uint32_t *args = in.args(n);
+            for (uint32_t k = 0; k != in.numArgs(n); ++k)
+                args_.push_back(map_[args[k]]);
+            return impure(out.addCall(n.sym, args_.data(), in.numArgs(n)));
+        }
+        case FlatKind::If:
+            return impure(out.addIf(map_[n.kids[0]], map_[n.kids[1]],
+                                    mapKid(map_, n.kids[2])));
+        case FlatKind::For:
+            return impure(out.addFor(n.sym, map_[n.kids[0]], map_[n.kids[1]],
+                                     mapKid(map_, n.kids[2]),
+                                     map_[n.kids[3]]));
+        }
+        return kNoNode;
+    }
+
+    uint32_t rewriteBinary(const FlatNode &n, FlatExpr &out) {
+        uint32_t lhs = map_[n.kids[0]];
+        uint32_t rhs = map_[n.kids[1]];
+        if (!isBuiltin(n.op))
+            return impure(out.addBinary(n.op, lhs, rhs));
+
+        if (out[lhs].kind == FlatKind::Number &&
+            out[rhs].kind == FlatKind::Number) {
+            ++stats_.folded;
+            double l = out[lhs].num, r = out[rhs].num;
+            switch (n.op) {
+            case '+':
+                return number(out, l + r);
+            case '-':
+                return number(out, l - r);
+            case '*':
+                return number(out, l * r);
+            default: // unordered or less than, like FCmpULT
+                return number(out,
+                              std::isnan(l) || std::isnan(r) || l < r ? 1.0
+                                                                      : 0.0);
+            }
+        }
+
+        uint32_t same = kNoNode;
+        if (n.op == '*' && isNumber(out, rhs, 1.0)) same = lhs;
+        if (n.op == '*' && isNumber(out, lhs, 1.0)) same = rhs;
+        if (n.op == '-' && isNumber(out, rhs, 0.0)) same = lhs;
+        if (n.op == '+' && isNumber(out, rhs, -0.0)) same = lhs;
+        if (n.op == '+' && isNumber(out, lhs, -0.0)) same = rhs;
+        if (same != kNoNode) {
+            ++stats_.simplified;
+            return same;
+        }
+
+        if (!pure_[lhs] || !pure_[rhs])
+            return impure(out.addBinary(n.op, lhs, rhs));
+        // + and * commute, so a+b and b+a are the same node
+        if ((n.op == '+' || n.op == '*') && rhs < lhs) std::swap(lhs, rhs);
+        return intern(out, {FlatKind::Binary, n.op, kNoSymbol, lhs, rhs, 0});
+    }
+
+    // the nodes of e reachable from root, in the same order
+    FlatExpr compact(const FlatExpr &e, uint32_t root) {
+        std::vector<uint8_t> live(root + 1, 0);
+        live[root] = 1;
+        for (uint32_t i = root + 1; i-- != 0;) {
+            if (!live[i]) continue;
+            const FlatNode &n = e[i];
+            if (n.kind == FlatKind::Call) {
+                for (uint32_t k = 0; k != e.numArgs(n); ++k)
+                    live[e.args(n)[k]] = 1;
+            } else if (n.kind != FlatKind::Number &&
+                       n.kind != FlatKind::Variable) {
+                for (uint32_t k : n.kids)
+                    if (k != kNoNode) live[k] = 1;
+            }
+        }
+
+        FlatExpr out;
+        std::vector<uint32_t> map(root + 1, kNoNode);
+        for (uint32_t i = 0; i <= root; ++i) {
+            if (!live[i]) continue;
+            const FlatNode &n = e[i];
+            switch (n.kind) {
+            case FlatKind::Number:
+                map[i] = out.addNumber(n.num);
+                break;
+            case FlatKind::Variable:
+                map[i] = out.addVariable(n.sym);
+                break;
+            case FlatKind::Binary:
+                map[i] = out.addBinary(n.op, map[n.kids[0]], map[n.kids[1]]);
+                break;
+            case FlatKind::Unary:
+                map[i] = out.addUnary(n.op, map[n.kids[0]]);
+                break;
+            case FlatKind::Call: {
+                args_.clear();
+                for (uint32_t k = 0; k != e.numArgs(n); ++k)
+                    args_.push_back(map[e.args(n)[k]]);
+                map[i] = out.addCall(n.sym, args_.data(), e.numArgs(n));
+                break;
+            }
+            case FlatKind::If:
+                map[i] = out.addIf(map[n.kids[0]], map[n.kids[1]],
+                                   mapKid(map, n.kids[2]));
+                break;
+            case FlatKind::For:
+                map[i] = out.addFor(n.sym, map[n.kids[0]], map[n.kids[1]],
+                                    mapKid(map, n.kids[2]), map[n.kids[3]]);
+                break;
+            }
+        }
+        return out;
+    }
+
+    FlatOptStats &stats_;
+    // input node -> output node
+    std::vector<uint32_t> map_;
+    // per output node: may be merged with an identical one
+    std::vector<uint8_t> pure_;
+    std::unordered_map<Key, uint32_t, KeyHash> consed_;
+    std::vector<uint32_t> args_;
+};
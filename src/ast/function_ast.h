@@ -14,7 +14,12 @@
  */
 // This class represents a function definition
 #pragma once
+#include "ast_arena.h"
 #include "compiler_type.h"
+#include "flat_ast.h"
+#include "flat_codegen.h"
+#include "flat_opt.h"
+#include "interner.h"
 #include "llvm-18/llvm/IR/Function.h"
 #include "logger.h"
 #include <llvm-18/llvm/IR/IRBuilder.h>
@@ -26,16 +31,63 @@ template <CompilerType CT> class PrototypeAST;
 template <CompilerType CT> class BinaryOperatorAST;
 template <CompilerType CT> class ExprAST;
 
+// The body's nodes are owned by arena_, so the whole expression tree is freed
+//  in one shot together with the FunctionAST
 template <CompilerType CT> class FunctionAST {
 public:
-    FunctionAST(std::unique_ptr<PrototypeAST<CT>> proto,
-                std::unique_ptr<ExprAST<CT>> body, ParserEnv<CT> *env)
-        : proto_(std::move(proto)), body_(std::move(body)), env_(env) {}
+    FunctionAST(std::unique_ptr<PrototypeAST<CT>> proto, ExprAST<CT> *body,
+                std::unique_ptr<AstArena> arena, ParserEnv<CT> *env)
+        : env_(env), proto_(std::move(proto)), arena_(std::move(arena)),
+          body_(body) {}
+
+    const AstArena &getArena() const __attribute__((always_inline)) {
+        return *arena_;
+    }
+
+    // Lower the body into flat_; codegen() then emits from the flat encoding
+    //  instead of walking the tree
+    void flatten() {
+        flat_.clear();
+        body_->flatten(flat_);
+    }
+
+    // fold and hash-cons the flat encoding; call after flatten()
+    void optimize(FlatOptStats &stats) { FlatOptimizer(stats).run(flat_); }
+
+    // What every driver does to a parsed definition before its codegen (or
+    //  bytecode): lowers it to the flat encoding when that is what codegen
+    //  uses (-tree-codegen not given), and simplifies that with -ast-opt
+    void lower(bool flat, bool optimizeFlat, FlatOptStats &stats) {
+        if (!flat) return;
+        flatten();
+        if (optimizeFlat) optimize(stats);
+    }
+
+    const FlatExpr &getFlat() const __attribute__((always_inline)) {
+        return flat_;
+    }
+
+    const PrototypeAST<CT> &getProto() const __attribute__((always_inline)) {
+        return proto_ ? *proto_ : *declared_;
+    }
+
+    // JIT: hand the prototype (and the precedence of a binary operator) to
+    //  the env ahead of codegen, which may come much later or never: the
+    //  interpreter tier runs the body from bytecode first (-interp)
+    void declare() {
+        declared_ = proto_.get();
+        if (declared_->isBinaryOp()) {
+            auto &binop = static_cast<BinaryOperatorAST<CT> &>(*declared_);
+            env_->setBinoPrecedence(binop.getOpName(),
+                                    binop.getBinaryPrecedence());
+        }
+        env_->addProto(proto_);
+    }
 
     llvm::Function *codegen() {
 
         llvm::Function *theFunction;
-        PrototypeAST<CT> &p = *proto_;
+        PrototypeAST<CT> &p = proto_ ? *proto_ : *declared_;
 
         if constexpr (CT == CompilerType::AOT) {
 
@@ -49,7 +101,9 @@ public:
                 int tempi = 0;
                 if (theFunction->arg_size() == pargs.size()) {
                     for (auto &arg : fargs) {
-                        if (std::string(arg.getName()) != pargs[tempi]) {
+                        if (arg.getName() !=
+                            llvm::StringRef(
+                                Interner::global().str(pargs[tempi]))) {
                             argsSame = false;
                             break;
                         }
@@ -78,8 +132,8 @@ public:
             // FunctionProtos map,
             //  but keep a reference to it for use below.
             // auto &p = *proto_;
-            env_->addProto(proto_);
-            theFunction = env_->getFunction(p.getName());
+            if (proto_) env_->addProto(proto_);
+            theFunction = env_->getFunction(p.getSymbol());
             if (!theFunction) return nullptr;
         }
         if (p.isBinaryOp()) {
@@ -96,14 +150,21 @@ public:
 
         // record the function arguments in the namedvalues table
         env_->clearNamedValues();
+        const std::vector<SymbolId> &argSyms = p.getArgs();
+        unsigned idx = 0;
         for (auto &arg : theFunction->args()) {
-            env_->setValue(std::string(arg.getName()), &arg);
+            env_->setValue(argSyms[idx++], &arg);
         }
-        if (llvm::Value *retVal = body_->codegen()) {
+        llvm::Value *retVal = flat_.empty()
+                                  ? body_->codegen()
+                                  : FlatCodegen<CT>(flat_, env_).codegen();
+        if (retVal) {
             curBuilder->CreateRet(retVal);
             llvm::verifyFunction(*theFunction);
-            // after verifying consistency, do optimizations
-            if (env_->getEnableOpt()) env_->runOpt(theFunction);
+            // after verifying consistency, do optimizations. The JIT module
+            //  holds just this function; the AOT module is optimized as a
+            //  whole once the input ends
+            if constexpr (CT == CompilerType::JIT) env_->optimizeModule();
             return theFunction;
         }
 
@@ -119,5 +180,9 @@ public:
 private:
     ParserEnv<CT> *env_;
     std::unique_ptr<PrototypeAST<CT>> proto_;
-    std::unique_ptr<ExprAST<CT>> body_;
+    // once declare() has moved proto_ to the env
+    PrototypeAST<CT> *declared_ = nullptr;
+    std::unique_ptr<AstArena> arena_;
+    ExprAST<CT> *body_;
+    FlatExpr flat_;
 };
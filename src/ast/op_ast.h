@@ -19,7 +19,7 @@
 
 template <CompilerType CT> class BinaryOperatorAST : public PrototypeAST<CT> {
 public:
-    BinaryOperatorAST(const std::string &name, std::vector<std::string> args,
+    BinaryOperatorAST(SymbolId name, std::vector<SymbolId> args,
                       unsigned precedence, ParserEnv<CT> *env)
         : PrototypeAST<CT>(name, args, env), precedence_(precedence) {
         this->thisType_ = PrototypeType::Binary;
@@ -32,7 +32,7 @@ protected:
 
 template <CompilerType CT> class UnaryOperatorAST : public PrototypeAST<CT> {
 public:
-    UnaryOperatorAST(const std::string &name, std::vector<std::string> args,
+    UnaryOperatorAST(SymbolId name, std::vector<SymbolId> args,
                      ParserEnv<CT> *env)
         : PrototypeAST<CT>(name, args, env) {
         this->thisType_ = PrototypeType::Unary;
@@ -14,6 +14,7 @@
  */
 #pragma once
 #include "compiler_type.h"
+#include "interner.h"
 #include <llvm-18/llvm/IR/Function.h>
 #include <memory>
 #include <vector>
@@ -26,14 +27,15 @@ enum class PrototypeType { NonOp, Unary, Binary };
 //  its name, arg names, arg number
 template <CompilerType CT> class PrototypeAST {
 public:
-    PrototypeAST(const std::string &name, std::vector<std::string> args,
-                 ParserEnv<CT> *env)
+    PrototypeAST(SymbolId name, std::vector<SymbolId> args, ParserEnv<CT> *env)
         : name_(name), args_(std::move(args)), env_(env),
           thisType_(PrototypeType::NonOp) {}
 
-    const std::string &getName() const { return name_; }
+    SymbolId getSymbol() const { return name_; }
 
-    const std::vector<std::string> &getArgs() const { return args_; }
+    std::string_view getName() const { return Interner::global().str(name_); }
+
+    const std::vector<SymbolId> &getArgs() const { return args_; }
 
     bool isUnaryOp() const {
         return thisType_ != PrototypeType::NonOp && args_.size() == 1;
@@ -45,33 +47,37 @@ public:
 
     char getOpName() const {
         assert(isUnaryOp() || isBinaryOp());
-        return name_[name_.size() - 1];
+        return getName().back();
     }
 
-    llvm::Function *codegen() {
+    llvm::Function *codegen() { return codegen(env_); }
+
+    // declare the function in the module of env, which need not be the env
+    //  the prototype was parsed with
+    llvm::Function *codegen(ParserEnv<CT> *env) const {
         // create the arguments list for the function prototype
         std::vector<llvm::Type *> doubles(
-            args_.size(), llvm::Type::getDoubleTy(*(env_->getContext())));
+            args_.size(), llvm::Type::getDoubleTy(*(env->getContext())));
         // make the function type: double(double, double), etc.
         llvm::FunctionType *FT = llvm::FunctionType::get(
-            llvm::Type::getDoubleTy(*(env_->getContext())), doubles, false);
+            llvm::Type::getDoubleTy(*(env->getContext())), doubles, false);
         // codegen for function prototype. “external linkage” means that the
         //  function may be defined outside the current module and/or that it is
         //  callable by functions outside the module. Name passed in is the name
         //  the user specified: since "TheModule" is specified, this name is
         //  registered in "TheModule"s symbol table.
         llvm::Function *F = llvm::Function::Create(
-            FT, llvm::Function::ExternalLinkage, name_, env_->getModule());
+            FT, llvm::Function::ExternalLinkage, getName(), env->getModule());
         unsigned Idx = 0;
         for (auto &arg : F->args()) {
-            arg.setName(args_[Idx++]);
+            arg.setName(Interner::global().str(args_[Idx++]));
         }
         return F;
     }
 
 protected:
     ParserEnv<CT> *env_;
-    std::string name_;
-    std::vector<std::string> args_;
+    SymbolId name_;
+    std::vector<SymbolId> args_;
     PrototypeType thisType_;
 };
@@ -0,0 +1,107 @@
+/*
+ * File: deep_expr_bench.cpp
+ * Path: /bench/deep_expr_bench.cpp
+ * Module: bench
+ * Lang: C/C++
+ * Created Date: Sunday, October 18th 2026, 10:14:09 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file stresses the parser and the flat codegen with very deeply
+    nested expressions, which must not run out of thread stack.
+    usage: deep_expr_bench [depth]
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#include "parser.h"
+#include "source_buffer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// One shape of nesting, as a definition of f(x) 'depth' levels deep. The
+//  prelude defines what the body calls.
+struct Shape {
+    const char *name;
+    const char *prelude;
+    const char *open; // repeated depth times before the innermost x
+    const char *close; // and after it
+};
+
+static const Shape kShapes[] = {
+    {"parens", "", "(", ")"},
+    {"unary", "def unary!(v) 0 - v;", "!", ""},
+    {"call", "def g(a b) a + b;", "g(1, ", ")"},
+    {"if-then", "", "if x then ", " else 1"},
+    {"if-else", "", "if x then 1 else ", ""},
+    {"for-body", "", "for i = 1, i < 2 do ", ""},
+    {"right-add", "", "1 + (", ")"},
+    {"left-add", "", "", " + 1"},
+    {"mixed-prec", "", "1 * 2 + 3 < (", ")"},
+};
+
+static std::string makeSource(const Shape &shape, size_t depth) {
+    std::string open, close;
+    for (size_t i = 0; i != depth; ++i) open += shape.open;
+    for (size_t i = 0; i != depth; ++i) close += shape.close;
+    return std::string(shape.prelude) + "\ndef f(x) " + open + "x" + close +
+           ";\n";
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point t0) {
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    return dt.count();
+}
+
+// parses, flattens and compiles every definition of the source; false if
+//  any of them fails
+static bool run(const Shape &shape, size_t depth) {
+    using Clock = std::chrono::steady_clock;
+    std::string text = makeSource(shape, depth);
+    Parser<CompilerType::AOT> parser(0, SourceBuffer::fromString(text));
+    double parseSec = 0, flattenSec = 0, codegenSec = 0;
+    size_t flatNodes = 0;
+    bool ok = true;
+    while (parser.getCurToken() != tokEof) {
+        if (parser.getCurToken() == ';') {
+            parser.getNextToken();
+            continue;
+        }
+        auto t0 = Clock::now();
+        auto defAST = parser.parseDefinition();
+        parseSec += secondsSince(t0);
+        if (!defAST) {
+            ok = false;
+            break;
+        }
+
+        t0 = Clock::now();
+        defAST->flatten();
+        flattenSec += secondsSince(t0);
+        flatNodes += defAST->getFlat().size();
+
+        t0 = Clock::now();
+        ok &= defAST->codegen() != nullptr;
+        codegenSec += secondsSince(t0);
+    }
+    printf("%-11s %8zu nodes  parse %7.2f ms  flatten %7.2f ms  "
+           "codegen %8.2f ms  %s\n",
+           shape.name, flatNodes, parseSec * 1e3, flattenSec * 1e3,
+           codegenSec * 1e3, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Parsing, flattening and the flat codegen keep explicit stacks on the
+//  heap, so a depth far beyond what recursion fits in a default 8 MB stack
+//  must pass. The tree codegen (-tree-codegen) is still recursive and is
+//  not run here.
+int main(int argc, char *argv[]) {
+    size_t depth = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    printf("depth %zu\n", depth);
+    bool ok = true;
+    for (const Shape &shape : kShapes) ok &= run(shape, depth);
+    return ok ? 0 : 1;
+}
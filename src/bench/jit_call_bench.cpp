@@ -0,0 +1,124 @@
+/*
+ * File: jit_call_bench.cpp
+ * Path: /bench/jit_call_bench.cpp
+ * Module: bench
+ * Lang: C/C++
+ * Created Date: Thursday, October 22nd 2026, 1:52:30 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file calls many small JIT'd functions round robin, each defined in
+    a module of its own, to compare where the JIT places their code.
+    usage: jit_call_bench [functions] [rounds]
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#include "huge_page_memory.h"
+#include "parser.h"
+#include "source_buffer.h"
+#include <llvm-18/llvm/Support/Error.h>
+#include <llvm-18/llvm/Support/TargetSelect.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using JITFn = double (*)(double);
+
+static std::string makeSource(size_t functions) {
+    std::string text;
+    for (size_t i = 0; i != functions; ++i)
+        text += "def f" + std::to_string(i) + "(x) x * 0.5 + " +
+                std::to_string(i) + ";\n";
+    return text;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point t0) {
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    return dt.count();
+}
+
+// JITs every function as the driver does, one module each, then calls them
+//  in turn for the given rounds. hugePages is set once the JIT is made, if
+//  config makes one.
+static bool run(const char *name, size_t functions, size_t rounds,
+                const llvm::orc::KaleidoscopeJITConfig &config,
+                HugePageMemoryManager *const &hugePages = nullptr) {
+    using Clock = std::chrono::steady_clock;
+    llvm::ExitOnError exitOnErr;
+    auto t0 = Clock::now();
+    Parser<CompilerType::JIT> parser(2, SourceBuffer::fromString(
+                                            makeSource(functions)),
+                                     config);
+    ParserEnv<CompilerType::JIT> *env = parser.getEnv();
+    while (parser.getCurToken() != tokEof) {
+        if (parser.getCurToken() == ';') {
+            parser.getNextToken();
+            continue;
+        }
+        auto defAST = parser.parseDefinition();
+        if (!defAST) return false;
+        defAST->flatten();
+        if (!defAST->codegen()) return false;
+        exitOnErr(env->getJIT()->addModule(env->takeModule()));
+    }
+
+    std::vector<JITFn> fns;
+    std::unordered_set<uintptr_t> pages;
+    for (size_t i = 0; i != functions; ++i) {
+        auto sym = exitOnErr(env->getJIT()->lookup("f" + std::to_string(i)));
+        fns.push_back(sym.getAddress().toPtr<JITFn>());
+        pages.insert((uintptr_t)fns.back() >> 12);
+    }
+    double linkSec = secondsSince(t0);
+
+    // one round to fault everything in, then the timed ones
+    double x = 0;
+    for (JITFn fn : fns) x = fn(x);
+    t0 = Clock::now();
+    for (size_t r = 0; r != rounds; ++r)
+        for (JITFn fn : fns) x = fn(x);
+    double callSec = secondsSince(t0);
+
+    printf("%-11s %6zu code pages  jit %8.2f ms  %6.2f ns/call  (%g)\n",
+           name, pages.size(), linkSec * 1e3,
+           callSec * 1e9 / (double)(rounds * functions), x);
+    if (hugePages) hugePages->getStats().print();
+    return true;
+}
+
+// The default RuntimeDyld setup maps pages of code for every module, and
+//  so does JITLink with its slab manager, which rounds each segment up to a
+//  page; HugePageMemoryManager packs the code of all modules together. The
+//  difference is in the iTLB misses of the round robin, which grow with
+//  the number of functions once their pages outnumber the iTLB entries.
+int main(int argc, char *argv[]) {
+    size_t functions = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4000;
+    size_t rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+    printf("%zu functions, %zu rounds\n", functions, rounds);
+
+    bool ok = run("rtdyld", functions, rounds, {});
+
+    llvm::orc::KaleidoscopeJITConfig slabs;
+    slabs.JITLinkSlabSize = 64 << 20;
+    ok &= run("jitlink", functions, rounds, slabs);
+
+    HugePageMemoryManager *hugePages = nullptr;
+    llvm::orc::KaleidoscopeJITConfig packed;
+    packed.JITLinkMemory = [&hugePages]() {
+        auto mm = std::make_unique<HugePageMemoryManager>(64 << 20);
+        hugePages = mm.get();
+        return mm;
+    };
+    ok &= run("huge-pages", functions, rounds, packed, hugePages);
+    return ok ? 0 : 1;
+}
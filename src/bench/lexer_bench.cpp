@@ -0,0 +1,152 @@
+/*
+ * File: lexer_bench.cpp
+ * Path: /bench/lexer_bench.cpp
+ * Module: bench
+ * Lang: C/C++
+ * Created Date: Friday, October 16th 2026, 4:02:37 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file measures lexer throughput in MB/s, stdin stream mode against
+    the mmapped buffer mode, and the run scanners of the buffer mode alone
+    when built scalar, for SSE2 and for AVX2.
+    usage: lexer_bench [size in MB] [seed files...]
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#include "lexer.h"
+#include "lexer_scan.h"
+#include "source_buffer.h"
+#include "token.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+// the same tokens are fed to both modes, so a sum over them keeps the
+//  compiler honest and double checks that the modes agree
+struct LexResult {
+    size_t tokens = 0;
+    double checksum = 0;
+};
+
+static LexResult lexAll(Lexer &lexer) {
+    LexResult res;
+    int tok;
+    while ((tok = lexer.getTok()) != tokEof) {
+        ++res.tokens;
+        if (tok == tokNumber) res.checksum += lexer.getNumVal();
+        if (tok == tokIdentifier) res.checksum += lexer.getIdentifier().size();
+    }
+    return res;
+}
+
+template <typename F> static double bestSeconds(int runs, F f) {
+    double best = 1e30;
+    for (int i = 0; i < runs; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+        if (dt.count() < best) best = dt.count();
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    size_t sizeMB = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 32;
+    std::string seed;
+    for (int i = 2; i < argc; ++i) {
+        std::ifstream in(argv[i]);
+        if (!in) {
+            std::cerr << "Error: Failed to open " << argv[i] << std::endl;
+            return 1;
+        }
+        std::stringstream ss;
+        ss << in.rdbuf() << "\n";
+        seed += ss.str();
+    }
+    if (seed.empty()) {
+        std::cerr << "usage: lexer_bench [size in MB] code.test op.test"
+                  << std::endl;
+        return 1;
+    }
+
+    // scale the seed corpus up to the requested size
+    std::string corpus;
+    corpus.reserve(sizeMB << 20);
+    while (corpus.size() < (sizeMB << 20)) corpus += seed;
+
+    char path[] = "/tmp/lexer_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, corpus.data(), corpus.size()) !=
+                      (ssize_t)corpus.size()) {
+        std::cerr << "Error: Failed to write the corpus." << std::endl;
+        return 1;
+    }
+    close(fd);
+
+    double mb = (double)corpus.size() / (1 << 20);
+    LexResult stream, buffer;
+
+    double streamSec = bestSeconds(3, [&] {
+        if (freopen(path, "r", stdin) == nullptr) std::abort();
+        Lexer lexer;
+        stream = lexAll(lexer);
+    });
+    double bufferSec = bestSeconds(3, [&] {
+        Lexer lexer(SourceBuffer::fromFile(path));
+        buffer = lexAll(lexer);
+    });
+    auto source = SourceBuffer::fromFile(path);
+    unlink(path);
+
+    printf("corpus: %.1f MB, %zu tokens\n", mb, buffer.tokens);
+    printf("stream (getchar): %8.1f MB/s\n", mb / streamSec);
+    printf("buffer (mmap):    %8.1f MB/s  x%.1f\n", mb / bufferSec,
+           streamSec / bufferSec);
+    if (stream.tokens != buffer.tokens || stream.checksum != buffer.checksum) {
+        printf("error: the two modes disagree\n");
+        return 1;
+    }
+
+    // the scanners without the rest of the lexer, one build per instruction
+    //  set; SSE2 is what the buffer mode above runs unless built with -mavx2
+    struct {
+        const char *name;
+        lexscan::ScanResult (*scan)(const char *, const char *);
+        bool supported;
+    } scanners[] = {
+        {"scalar", lexscan::scalar::scan, true},
+        {"sse2", lexscan::sse2::scan, true},
+        {"avx2", lexscan::avx2::scan, __builtin_cpu_supports("avx2") != 0},
+    };
+    // keywords count as identifiers here, so only the scanners share a checksum
+    lexscan::ScanResult scalar;
+    double scalarSec = 0;
+    for (auto &s : scanners) {
+        if (!s.supported) {
+            printf("scan %-7s        (not supported by this CPU)\n", s.name);
+            continue;
+        }
+        lexscan::ScanResult res;
+        double sec = bestSeconds(
+            3, [&] { res = s.scan(source->begin(), source->end()); });
+        if (scalarSec == 0) {
+            scalar = res;
+            scalarSec = sec;
+        }
+        printf("scan %-7s %8.1f MB/s  x%.2f\n", s.name, mb / sec,
+               scalarSec / sec);
+        if (res.tokens != buffer.tokens || res.checksum != scalar.checksum) {
+            printf("error: the %s scanner disagrees with the lexer\n", s.name);
+            return 1;
+        }
+    }
+    return 0;
+}
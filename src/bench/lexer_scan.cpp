@@ -0,0 +1,54 @@
+/*
+ * File: lexer_scan.cpp
+ * Path: /bench/lexer_scan.cpp
+ * Module: bench
+ * Lang: C/C++
+ * Created Date: Friday, October 23rd 2026, 6:12:40 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file walks a source with the scanners of char_scan.h alone, the
+    way the buffer mode of the lexer does. lexer_bench builds it once per
+    instruction set (KS_LEXER_NO_SIMD, SSE2, -mavx2), each in the namespace
+    named by KS_SCAN_ISA.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#include "char_scan.h"
+#include "lexer_scan.h"
+
+namespace lexscan {
+namespace KS_SCAN_ISA {
+
+// [begin, end) followed by charscan::kBlock readable zero bytes
+ScanResult scan(const char *begin, const char *end) {
+    ScanResult res;
+    const char *p = begin;
+    while (true) {
+        p = charscan::skipSpace(p);
+        if (*p == '#') {
+            do {
+                p = charscan::findLineEnd(p + 1);
+            } while (*p == '\0' && p != end);
+            continue;
+        }
+        if (p == end) return res;
+        ++res.tokens;
+        if (charscan::is(*p, charscan::ccAlpha)) {
+            const char *start = p;
+            p = charscan::skipAlnum(p + 1);
+            res.checksum += (double)(p - start);
+        } else if (charscan::is(*p, charscan::ccDigit | charscan::ccDot)) {
+            const char *start = p;
+            p = charscan::skipNumber(p + 1);
+            res.checksum += charscan::parseNumber(start, p);
+        } else {
+            ++p;
+        }
+    }
+}
+
+} // namespace KS_SCAN_ISA
+} // namespace lexscan
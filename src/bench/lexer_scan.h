@@ -0,0 +1,38 @@
+/*
+ * File: lexer_scan.h
+ * Path: /bench/lexer_scan.h
+ * Module: bench
+ * Lang: C/C++
+ * Created Date: Friday, October 23rd 2026, 6:12:40 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file declares the scan loop of lexer_scan.cpp for each instruction
+    set it is built for.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <cstddef>
+
+namespace lexscan {
+
+// tokens found, and the sum of identifier lengths and number values
+struct ScanResult {
+    size_t tokens = 0;
+    double checksum = 0;
+};
+
+namespace scalar {
+ScanResult scan(const char *begin, const char *end);
+}
+namespace sse2 {
+ScanResult scan(const char *begin, const char *end);
+}
+namespace avx2 {
+ScanResult scan(const char *begin, const char *end);
+}
+
+} // namespace lexscan
@@ -0,0 +1,109 @@
+/*
+ * File: bytecode.h
+ * Path: /interp/bytecode.h
+ * Module: interp
+ * Lang: C/C++
+ * Created Date: Wednesday, October 21st 2026, 10:12:37 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file defines the register bytecode the interpreter tier runs.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "interner.h"
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+enum class Op : uint8_t {
+    Const,    // r[a] = consts[wide]
+    Move,     // r[a] = r[b]
+    Add,      // r[a] = r[b] + r[c]
+    Sub,      // r[a] = r[b] - r[c]
+    Mul,      // r[a] = r[b] * r[c]
+    Lt,       // r[a] = r[b] < r[c] or unordered ? 1 : 0, as fcmp ult
+    Jmp,      // pc = wide
+    JmpIfNot, // if !(r[a] != 0, ordered) pc = wide, as fcmp one
+    JmpIf,    // if r[a] != 0, ordered: pc = wide
+    Call,     // r[a] = wide(r[a], .., r[a + n - 1])
+    Ret,      // return r[a]
+};
+constexpr unsigned kNumOps = static_cast<unsigned>(Op::Ret) + 1;
+
+// One instruction, 8 bytes. Registers are 16 bits; a jump target, a
+//  constant index or a callee is 32 bits, split over b and c (wide()).
+//  Arguments are passed in place: a call's n arguments are in registers
+//  a.., which become registers 0.. of the callee, and the result comes
+//  back in a.
+struct Insn {
+    Op op;
+    uint8_t n;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+
+    uint32_t wide() const __attribute__((always_inline)) {
+        return b | (uint32_t)c << 16;
+    }
+};
+static_assert(sizeof(Insn) == 8, "keep eight instructions per cache line");
+
+// The bytecode of a function or of a top-level expression. Registers 0..
+//  are its arguments, the rest hold loop variables and temporaries.
+struct BytecodeFunction {
+    SymbolId name = Interner::symAnonExpr;
+    uint32_t numArgs = 0;
+    uint32_t numRegs = 0;
+    std::vector<Insn> code;
+    std::vector<double> consts;
+    // has a for loop, the code the JIT is for
+    bool hasLoop = false;
+
+    void print(FILE *out) const {
+        std::string_view fn = Interner::global().str(name);
+        fprintf(out, "bytecode %.*s, %u args, %u registers:\n",
+                (int)fn.size(), fn.data(), numArgs, numRegs);
+        static const char *const names[kNumOps] = {
+            "const", "move",     "add",   "sub",  "mul", "lt",
+            "jmp",   "jmpifnot", "jmpif", "call", "ret"};
+        for (size_t i = 0; i != code.size(); ++i) {
+            const Insn &in = code[i];
+            fprintf(out, "%6zu  %-9s", i, names[(unsigned)in.op]);
+            switch (in.op) {
+            case Op::Const:
+                fprintf(out, "r%u, %g\n", in.a, consts[in.wide()]);
+                break;
+            case Op::Move:
+                fprintf(out, "r%u, r%u\n", in.a, in.b);
+                break;
+            case Op::Add:
+            case Op::Sub:
+            case Op::Mul:
+            case Op::Lt:
+                fprintf(out, "r%u, r%u, r%u\n", in.a, in.b, in.c);
+                break;
+            case Op::Jmp:
+                fprintf(out, "%u\n", in.wide());
+                break;
+            case Op::JmpIfNot:
+            case Op::JmpIf:
+                fprintf(out, "r%u, %u\n", in.a, in.wide());
+                break;
+            case Op::Call: {
+                std::string_view callee = Interner::global().str(in.wide());
+                fprintf(out, "r%u, %.*s/%u\n", in.a, (int)callee.size(),
+                        callee.data(), in.n);
+                break;
+            }
+            case Op::Ret:
+                fprintf(out, "r%u\n", in.a);
+                break;
+            }
+        }
+    }
+};
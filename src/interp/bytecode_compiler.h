@@ -0,0 +1,323 @@
+/*
+ * File: bytecode_compiler.h
+ * Path: /interp/bytecode_compiler.h
+ * Module: interp
+ * Lang: C/C++
+ * Created Date: Wednesday, October 21st 2026, 11:03:52 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file compiles a FlatExpr to bytecode.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "bytecode.h"
+#include "compiler_type.h"
+#include "flat_ast.h"
+#include "interner.h"
+#include "logger.h"
+#include "scoped_symbol_table.h"
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+template <CompilerType CT> class ParserEnv;
+
+enum class BytecodeResult {
+    Ok,
+    Error,      // reported, as FlatCodegen would
+    Unsupported // fine, but over a limit of the bytecode: for the JIT
+};
+
+// Compiles the body of a function (or a top-level expression) to a
+//  BytecodeFunction, with the same checks and the same error messages as
+//  FlatCodegen, and the same order of evaluation. Like FlatCodegen it walks
+//  the node array with a stack of its own, so any depth is fine.
+//
+//  Registers are allocated as a stack: each node starts at the first free
+//  register, its mark, and leaves its value there if it computes one; a
+//  variable is just the register it lives in. The arguments of a call are
+//  thus evaluated straight into place, a move only being needed for a
+//  variable. A node shared by FlatOptimizer is pure and is simply evaluated
+//  again at each use.
+template <CompilerType CT> class BytecodeCompiler {
+public:
+    // The interpreter calls JIT-compiled code through a switch on the
+    //  number of arguments, up to this many; a call with more is left to
+    //  the JIT
+    static constexpr unsigned kMaxNativeArgs = 8;
+
+    BytecodeCompiler(const FlatExpr &expr, ParserEnv<CT> *env)
+        : expr_(expr), env_(env) {}
+
+    BytecodeResult compile(SymbolId name, const std::vector<SymbolId> &args,
+                           BytecodeFunction &out) {
+        if (expr_.empty() || args.size() > kMaxRegs)
+            return BytecodeResult::Unsupported;
+        out_ = &out;
+        out.name = name;
+        out.numArgs = (uint32_t)args.size();
+        vars_.clear();
+        consts_.clear();
+        top_ = 0;
+        for (SymbolId arg : args) vars_.bind(arg, top_++);
+        maxTop_ = top_;
+
+        stack_.clear();
+        stack_.push_back({expr_.root(), 0, top_});
+        uint32_t ret = 0;
+        while (!stack_.empty()) {
+            uint32_t next = step(stack_.back(), ret);
+            if (next == kFail) return BytecodeResult::Error;
+            if (next == kUnsupported) return BytecodeResult::Unsupported;
+            if (next == kDone)
+                stack_.pop_back();
+            else
+                stack_.push_back({next, 0, top_});
+        }
+        if (maxTop_ > kMaxRegs) return BytecodeResult::Unsupported;
+        emit(Op::Ret, ret);
+        out.numRegs = maxTop_;
+        return BytecodeResult::Ok;
+    }
+
+private:
+    static constexpr uint32_t kDone = kNoNode;
+    static constexpr uint32_t kFail = kNoNode - 1;
+    static constexpr uint32_t kUnsupported = kNoNode - 2;
+    static constexpr uint32_t kNoReg = ~(uint32_t)0;
+    static constexpr uint32_t kMaxRegs = 0x10000;
+
+    struct Frame {
+        uint32_t idx;
+        uint32_t stage;
+        uint32_t mark; // the first free register when the node started
+        uint32_t reg = 0;
+        uint32_t at[2] = {0, 0}; // jumps to patch, or a loop head
+    };
+
+    uint32_t alloc() {
+        uint32_t reg = top_++;
+        if (top_ > maxTop_) maxTop_ = top_;
+        return reg;
+    }
+
+    // puts val in reg, the first free register, and takes it
+    void place(uint32_t reg, uint32_t val) {
+        if (val != reg) emit(Op::Move, reg, val);
+        top_ = reg;
+        alloc();
+    }
+
+    uint32_t constant(double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof v);
+        auto [it, added] =
+            consts_.try_emplace(bits, (uint32_t)out_->consts.size());
+        if (added) out_->consts.push_back(v);
+        return it->second;
+    }
+
+    void emit(Op op, uint32_t a, uint32_t b = 0, uint32_t c = 0) {
+        out_->code.push_back(
+            {op, 0, (uint16_t)a, (uint16_t)b, (uint16_t)c});
+    }
+
+    void emitWide(Op op, uint32_t a, uint32_t wide, uint8_t n = 0) {
+        out_->code.push_back({op, n, (uint16_t)a, (uint16_t)(wide & 0xffff),
+                              (uint16_t)(wide >> 16)});
+    }
+
+    uint32_t here() const { return (uint32_t)out_->code.size(); }
+
+    // a jump to be patched to the code that follows, later
+    uint32_t emitJump(Op op, uint32_t a) {
+        emitWide(op, a, 0);
+        return here() - 1;
+    }
+
+    void patch(uint32_t at) {
+        out_->code[at].b = (uint16_t)(here() & 0xffff);
+        out_->code[at].c = (uint16_t)(here() >> 16);
+    }
+
+    // Advance the node of f. ret is the register of the child it asked for
+    //  last; when the node is done, ret is set to its register.
+    //  Returns the next child to compile, kDone, kFail or kUnsupported.
+    uint32_t step(Frame &f, uint32_t &ret) {
+        const FlatNode &n = expr_[f.idx];
+        switch (n.kind) {
+        case FlatKind::Number:
+            ret = alloc();
+            emitWide(Op::Const, ret, constant(n.num));
+            return kDone;
+        case FlatKind::Variable:
+            ret = vars_.lookup(n.sym);
+            if (ret != kNoReg) return kDone;
+            LogErr<CT>("unknown variable name");
+            return kFail;
+        case FlatKind::Binary:
+            return stepBinary(f, n, ret);
+        case FlatKind::Unary:
+            return stepCall(f, Interner::global().unaryOp(n.op), n.kids, 1,
+                            ret, "unknown unary operator");
+        case FlatKind::Call:
+            if (f.stage == 0) {
+                const auto *proto = env_->getProto(n.sym);
+                if (!proto) {
+                    LogErr<CT>("unknown function referenced");
+                    return kFail;
+                }
+                if (proto->getArgs().size() != expr_.numArgs(n)) {
+                    LogErr<CT>("incorrect number of args passed");
+                    return kFail;
+                }
+                if (expr_.numArgs(n) > kMaxNativeArgs) return kUnsupported;
+            }
+            return stepCall(f, n.sym, expr_.args(n), expr_.numArgs(n), ret,
+                            nullptr);
+        case FlatKind::If:
+            return stepIf(f, n, ret);
+        case FlatKind::For:
+            return stepFor(f, n, ret);
+        }
+        return kFail;
+    }
+
+    uint32_t stepBinary(Frame &f, const FlatNode &n, uint32_t &ret) {
+        Op op;
+        switch (n.op) {
+        case '+':
+            op = Op::Add;
+            break;
+        case '-':
+            op = Op::Sub;
+            break;
+        case '*':
+            op = Op::Mul;
+            break;
+        case '<':
+            op = Op::Lt;
+            break;
+        default:
+            // user-defined operator
+            return stepCall(f, Interner::global().binaryOp(n.op), n.kids, 2,
+                            ret, "invalid binary op (undefined)");
+        }
+        if (f.stage++ == 0) return n.kids[0];
+        if (f.stage == 2) {
+            f.reg = ret;
+            return n.kids[1];
+        }
+        top_ = f.mark;
+        uint32_t dst = alloc();
+        emit(op, dst, f.reg, ret);
+        ret = dst;
+        return kDone;
+    }
+
+    // The arguments go to the registers from f.mark on, where the callee
+    //  finds them. An operator is checked once its operands are compiled,
+    //  as FlatCodegen does: unknown names the error for one that is not
+    //  defined.
+    uint32_t stepCall(Frame &f, SymbolId callee, const uint32_t *args,
+                      uint32_t numArgs, uint32_t &ret, const char *unknown) {
+        if (f.stage != 0) place(f.mark + f.stage - 1, ret);
+        if (f.stage != numArgs) return args[f.stage++];
+        if (unknown && !env_->getProto(callee)) {
+            LogErr<CT>(unknown);
+            return kFail;
+        }
+        top_ = f.mark;
+        ret = alloc();
+        emitWide(Op::Call, ret, callee, (uint8_t)numArgs);
+        return kDone;
+    }
+
+    // the branches leave their value in the register of the if
+    uint32_t stepIf(Frame &f, const FlatNode &n, uint32_t &ret) {
+        switch (f.stage++) {
+        case 0:
+            return n.kids[0];
+        case 1:
+            f.at[0] = emitJump(Op::JmpIfNot, ret);
+            top_ = f.reg = f.mark;
+            return n.kids[1];
+        case 2:
+            place(f.reg, ret);
+            f.at[1] = emitJump(Op::Jmp, 0);
+            patch(f.at[0]);
+            top_ = f.reg;
+            if (n.kids[2] != kNoNode) return n.kids[2];
+            ret = alloc();
+            emitWide(Op::Const, ret, constant(0.0));
+            patch(f.at[1]);
+            return kDone;
+        default:
+            place(f.reg, ret);
+            patch(f.at[1]);
+            ret = f.reg;
+            return kDone;
+        }
+    }
+
+    // As ForExprAST::codegen(): the body, then the step and the end
+    //  condition, both still seeing the variable's value in this iteration,
+    //  then the variable takes its next value, kept in the register after
+    //  it meanwhile.
+    uint32_t stepFor(Frame &f, const FlatNode &n, uint32_t &ret) {
+        switch (f.stage++) {
+        case 0:
+            out_->hasLoop = true;
+            return n.kids[0]; // start
+        case 1:
+            f.reg = f.mark;
+            place(f.reg, ret);
+            alloc(); // next value
+            vars_.pushScope();
+            vars_.bind(n.sym, f.reg);
+            f.at[0] = here();
+            return n.kids[3]; // body
+        case 2:
+            top_ = f.reg + 2;
+            if (n.kids[2] != kNoNode) return n.kids[2]; // step
+            ret = alloc();
+            emitWide(Op::Const, ret, constant(1.0));
+            ++f.stage;
+            [[fallthrough]];
+        case 3:
+            emit(Op::Add, f.reg + 1, f.reg, ret);
+            top_ = f.reg + 2;
+            return n.kids[1]; // end
+        default: {
+            uint32_t cond = ret;
+            if (cond == f.reg) {
+                cond = alloc();
+                emit(Op::Move, cond, f.reg);
+            }
+            vars_.popScope();
+            emit(Op::Move, f.reg, f.reg + 1);
+            emitWide(Op::JmpIf, cond, f.at[0]);
+            top_ = f.mark;
+            ret = alloc();
+            emitWide(Op::Const, ret, constant(0.0));
+            return kDone;
+        }
+        }
+    }
+
+    const FlatExpr &expr_;
+    ParserEnv<CT> *env_;
+    BytecodeFunction *out_ = nullptr;
+    std::vector<Frame> stack_;
+    // the register of each variable in scope
+    ScopedSymbolTable<uint32_t, kNoReg> vars_;
+    // by bit pattern, so -0.0 and 0.0 stay apart
+    std::unordered_map<uint64_t, uint32_t> consts_;
+    uint32_t top_ = 0;
+    uint32_t maxTop_ = 0;
+};
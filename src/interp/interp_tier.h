@@ -0,0 +1,178 @@
+/*
+ * File: interp_tier.h
+ * Path: /interp/interp_tier.h
+ * Module: interp
+ * Lang: C/C++
+ * Created Date: Wednesday, October 21st 2026, 4:45:21 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file decides what the interpreter runs and what the JIT compiles.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "KaleidoSopceJIT.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "bytecode_compiler.h"
+#include "compiler_type.h"
+#include "flat_ast.h"
+#include "interner.h"
+#include "interpreter.h"
+#include <llvm-18/llvm/IR/Function.h>
+#include <llvm-18/llvm/Support/Error.h>
+#include <llvm-18/llvm/Support/raw_ostream.h>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+template <CompilerType CT> class ParserEnv;
+
+// The interpreter tier (-interp). Definitions and top-level expressions
+//  are compiled to bytecode first, which is cheap, and run by the
+//  Interpreter without LLVM. What goes to the JIT instead:
+//  - code with a for loop, at once: it is where the time goes, and a loop
+//    cannot be promoted while it runs;
+//  - a function once the interpreter calls it hotCalls times;
+//  - code the bytecode cannot hold (see BytecodeResult::Unsupported).
+//  The JIT links compiled code to compiled code only, so the bytecode
+//  functions a compiled function may call are compiled before it, and so
+//  on; the interpreter calls either kind.
+//
+//  Every def is still checked when it is read, with the errors codegen
+//  would report. A second def of a name fails the way the JIT does.
+template <CompilerType CT> class InterpTier {
+public:
+    InterpTier(ParserEnv<CT> *env, unsigned hotCalls,
+               std::function<llvm::Error(llvm::orc::ThreadSafeModule)>
+                   addDefinition)
+        : env_(env), addDefinition_(std::move(addDefinition)),
+          interp_(hotCalls,
+                  {[this](SymbolId name) { return resolve(name); },
+                   [this](SymbolId name) { return promote(name); }}) {}
+
+    // a definition after FunctionAST::lower()
+    llvm::Error addDefinition(std::unique_ptr<FunctionAST<CT>> fn) {
+        SymbolId name = fn->getProto().getSymbol();
+        if (defined_.count(name))
+            return llvm::make_error<llvm::StringError>(
+                "Duplicate definition of symbol '" +
+                    std::string(Interner::global().str(name)) + "'",
+                llvm::inconvertibleErrorCode());
+        // callable (by itself, too) from now on, as after codegen
+        fn->declare();
+        auto code = std::make_unique<BytecodeFunction>();
+        BytecodeResult res = BytecodeCompiler<CT>(fn->getFlat(), env_).compile(
+            name, fn->getProto().getArgs(), *code);
+        if (res == BytecodeResult::Error) return llvm::Error::success();
+        if (res == BytecodeResult::Ok && !code->hasLoop) {
+            fprintf(stderr, "Parsed a function definition.\n");
+            code->print(stderr);
+            defined_.insert(name);
+            interp_.define(name, std::move(code));
+            bytecodeOnly_[name] = std::move(fn);
+            return llvm::Error::success();
+        }
+        ++compiledAtOnce_;
+        return compile(*fn, /*log=*/true);
+    }
+
+    // Runs a top-level expression (after FunctionAST::lower()) unless it is
+    //  for the JIT, in which case it returns false and the driver takes it
+    //  on, what it calls being compiled already
+    llvm::Expected<bool> runExpression(FunctionAST<CT> &fn) {
+        BytecodeFunction code;
+        BytecodeResult res = BytecodeCompiler<CT>(fn.getFlat(), env_).compile(
+            Interner::symAnonExpr, {}, code);
+        if (res == BytecodeResult::Error) return true;
+        if (res == BytecodeResult::Ok && !code.hasLoop) {
+            fprintf(stderr, "Read a top-level expr: ");
+            code.print(stderr);
+            llvm::Expected<double> val = interp_.run(code);
+            if (!val) return val.takeError();
+            fprintf(stderr, "Evaluated to %f\n", *val);
+            return true;
+        }
+        if (auto err = compileCallees(fn.getFlat())) return std::move(err);
+        return false;
+    }
+
+    void printStats() const {
+        interp_.getStats().print();
+        fprintf(stderr,
+                "interp: %zu definitions compiled when read, %zu bytecode "
+                "functions compiled as callees of compiled code\n",
+                compiledAtOnce_, compiledAsCallees_);
+    }
+
+private:
+    // fn with the JIT, after the bytecode functions it calls
+    llvm::Error compile(FunctionAST<CT> &fn, bool log) {
+        if (auto err = compileCallees(fn.getFlat())) return err;
+        llvm::Function *ir = fn.codegen();
+        if (!ir) return llvm::Error::success();
+        if (log) {
+            fprintf(stderr, "Parsed a function definition.\n");
+            ir->print(llvm::errs());
+            fprintf(stderr, "\n");
+        }
+        defined_.insert(fn.getProto().getSymbol());
+        return addDefinition_(env_->takeModule());
+    }
+
+    llvm::Error compileCallees(const FlatExpr &expr) {
+        for (const FlatNode &n : expr.nodes()) {
+            SymbolId callee = kNoSymbol;
+            if (n.kind == FlatKind::Call)
+                callee = n.sym;
+            else if (n.kind == FlatKind::Unary)
+                callee = Interner::global().unaryOp(n.op);
+            else if (n.kind == FlatKind::Binary && !isBuiltin(n.op))
+                callee = Interner::global().binaryOp(n.op);
+            if (callee == kNoSymbol || !bytecodeOnly_.count(callee))
+                continue;
+            ++compiledAsCallees_;
+            if (auto err = promote(callee)) return err;
+        }
+        return llvm::Error::success();
+    }
+
+    // Interpreter::Hooks::promote, and the callees of compiled code
+    llvm::Error promote(SymbolId name) {
+        auto found = bytecodeOnly_.find(name);
+        if (found == bytecodeOnly_.end()) return llvm::Error::success();
+        std::unique_ptr<FunctionAST<CT>> fn = std::move(found->second);
+        // first, for a callee that calls it back
+        bytecodeOnly_.erase(found);
+        interp_.setCompiled(name);
+        return compile(*fn, /*log=*/false);
+    }
+
+    // Interpreter::Hooks::resolve: compiled code, or in the process
+    llvm::Expected<void *> resolve(SymbolId name) {
+        auto sym = env_->getJIT()->lookup(Interner::global().str(name));
+        if (!sym) return sym.takeError();
+        return sym->getAddress().template toPtr<void *>();
+    }
+
+    static bool isBuiltin(char op) {
+        return op == '+' || op == '-' || op == '*' || op == '<';
+    }
+
+    ParserEnv<CT> *env_;
+    std::function<llvm::Error(llvm::orc::ThreadSafeModule)> addDefinition_;
+    Interpreter interp_;
+    // the ASTs of the functions run from bytecode, for when they get hot
+    std::unordered_map<SymbolId, std::unique_ptr<FunctionAST<CT>>>
+        bytecodeOnly_;
+    std::unordered_set<SymbolId> defined_;
+    size_t compiledAtOnce_ = 0;
+    size_t compiledAsCallees_ = 0;
+};
@@ -0,0 +1,254 @@
+/*
+ * File: interpreter.h
+ * Path: /interp/interpreter.h
+ * Module: interp
+ * Lang: C/C++
+ * Created Date: Wednesday, October 21st 2026, 2:27:10 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file runs bytecode, calling into the JIT for what is compiled.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "bytecode.h"
+#include "interner.h"
+#include <llvm-18/llvm/Support/Error.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// What the interpreter did, for -stats
+struct InterpStats {
+    size_t expressions = 0; // top-level expressions run
+    size_t calls = 0;       // of bytecode functions
+    size_t nativeCalls = 0; // of compiled or in-process functions
+    size_t promoted = 0;    // bytecode functions that got hot
+
+    void print() const {
+        fprintf(stderr,
+                "interp: %zu expressions, %zu bytecode calls, %zu native "
+                "calls, %zu functions promoted\n",
+                expressions, calls, nativeCalls, promoted);
+    }
+};
+
+// Runs BytecodeFunctions. The functions it knows are kept by symbol; a call
+//  runs the callee's bytecode while it has some and is not compiled, and
+//  otherwise calls its native code, found through resolve() the first time.
+//  The callee's bytecode is counted in calls, and promote() is asked to
+//  compile it on the call that reaches hotCalls (0: never).
+//
+//  Dispatch is a computed goto, one indirect jump per instruction from the
+//  end of the previous one. Calls between bytecode functions do not recurse
+//  on the machine stack: each has a frame on frames_ and its registers on
+//  regs_, which start at the caller's argument registers.
+class Interpreter {
+public:
+    struct Hooks {
+        // the address of the native code of a function
+        std::function<llvm::Expected<void *>(SymbolId)> resolve;
+        // compiles a bytecode function with the JIT
+        std::function<llvm::Error(SymbolId)> promote;
+    };
+
+    Interpreter(unsigned hotCalls, Hooks hooks)
+        : hotCalls_(hotCalls), hooks_(std::move(hooks)) {}
+
+    // name runs fn from now on
+    void define(SymbolId name, std::unique_ptr<BytecodeFunction> fn) {
+        Slot &s = slot(name);
+        s.code = std::move(fn);
+        s.compiled = false;
+        s.native = nullptr;
+        s.calls = 0;
+    }
+
+    // name runs native code from now on. Its bytecode is kept for the
+    //  frames that may still be running it.
+    void setCompiled(SymbolId name) {
+        Slot &s = slot(name);
+        s.compiled = true;
+        s.native = nullptr;
+    }
+
+    bool isInterpreted(SymbolId name) const {
+        return name < slots_.size() && slots_[name].code &&
+               !slots_[name].compiled;
+    }
+
+    llvm::Expected<double> run(const BytecodeFunction &entry) {
+        ++stats_.expressions;
+        frames_.clear();
+        reserve(entry.numRegs);
+        const BytecodeFunction *fn = &entry;
+        const Insn *pc = fn->code.data();
+        const double *k = fn->consts.data();
+        size_t base = 0;
+        double *r = regs_.data();
+        const Insn *in;
+
+        static void *const dispatch[kNumOps] = {
+            &&op_Const, &&op_Move,     &&op_Add,   &&op_Sub,
+            &&op_Mul,   &&op_Lt,       &&op_Jmp,   &&op_JmpIfNot,
+            &&op_JmpIf, &&op_Call,     &&op_Ret};
+#define NEXT()                                                                 \
+    do {                                                                       \
+        in = pc++;                                                             \
+        goto *dispatch[static_cast<uint8_t>(in->op)];                          \
+    } while (0)
+
+        NEXT();
+    op_Const:
+        r[in->a] = k[in->wide()];
+        NEXT();
+    op_Move:
+        r[in->a] = r[in->b];
+        NEXT();
+    op_Add:
+        r[in->a] = r[in->b] + r[in->c];
+        NEXT();
+    op_Sub:
+        r[in->a] = r[in->b] - r[in->c];
+        NEXT();
+    op_Mul:
+        r[in->a] = r[in->b] * r[in->c];
+        NEXT();
+    op_Lt:
+        r[in->a] = !(r[in->b] >= r[in->c]) ? 1.0 : 0.0;
+        NEXT();
+    op_Jmp:
+        pc = fn->code.data() + in->wide();
+        NEXT();
+    op_JmpIfNot:
+        if (!isTrue(r[in->a])) pc = fn->code.data() + in->wide();
+        NEXT();
+    op_JmpIf:
+        if (isTrue(r[in->a])) pc = fn->code.data() + in->wide();
+        NEXT();
+    op_Call: {
+        Slot &s = slot(in->wide());
+        if (s.code && !s.compiled && hotCalls_ && ++s.calls == hotCalls_) {
+            if (auto err = hooks_.promote(in->wide())) return std::move(err);
+            ++stats_.promoted;
+        }
+        // slots_ may have grown
+        Slot &callee = slot(in->wide());
+        if (callee.code && !callee.compiled) {
+            ++stats_.calls;
+            frames_.push_back({fn, pc, base});
+            base += in->a;
+            fn = callee.code.get();
+            reserve(base + fn->numRegs);
+            pc = fn->code.data();
+            k = fn->consts.data();
+            r = regs_.data() + base;
+            NEXT();
+        }
+        if (!callee.native) {
+            auto addr = hooks_.resolve(in->wide());
+            if (!addr) return addr.takeError();
+            slot(in->wide()).native = *addr;
+        }
+        ++stats_.nativeCalls;
+        r[in->a] = callNative(slot(in->wide()).native, r + in->a, in->n);
+        NEXT();
+    }
+    op_Ret: {
+        double val = r[in->a];
+        if (frames_.empty()) return val;
+        const Frame &caller = frames_.back();
+        regs_[base] = val;
+        fn = caller.fn;
+        pc = caller.pc;
+        base = caller.base;
+        frames_.pop_back();
+        k = fn->consts.data();
+        r = regs_.data() + base;
+        NEXT();
+    }
+#undef NEXT
+    }
+
+    const InterpStats &getStats() const __attribute__((always_inline)) {
+        return stats_;
+    }
+
+private:
+    struct Slot {
+        std::unique_ptr<BytecodeFunction> code;
+        bool compiled = false;
+        void *native = nullptr;
+        uint32_t calls = 0;
+    };
+
+    struct Frame {
+        const BytecodeFunction *fn;
+        const Insn *pc; // to return to
+        size_t base;
+    };
+
+    // as fcmp one 0.0, what the JIT's code tests
+    static bool isTrue(double v) __attribute__((always_inline)) {
+        return v < 0.0 || v > 0.0;
+    }
+
+    Slot &slot(SymbolId name) __attribute__((always_inline)) {
+        if (name >= slots_.size()) slots_.resize(name + 1);
+        return slots_[name];
+    }
+
+    // regs_ moves when it grows: callers reload r
+    void reserve(size_t regs) {
+        if (regs > regs_.size()) regs_.resize(regs * 2);
+    }
+
+    static double callNative(void *fp, const double *a, unsigned n) {
+        using F0 = double (*)();
+        using F1 = double (*)(double);
+        using F2 = double (*)(double, double);
+        using F3 = double (*)(double, double, double);
+        using F4 = double (*)(double, double, double, double);
+        using F5 = double (*)(double, double, double, double, double);
+        using F6 = double (*)(double, double, double, double, double,
+                              double);
+        using F7 = double (*)(double, double, double, double, double, double,
+                              double);
+        using F8 = double (*)(double, double, double, double, double, double,
+                              double, double);
+        switch (n) {
+        case 0:
+            return ((F0)fp)();
+        case 1:
+            return ((F1)fp)(a[0]);
+        case 2:
+            return ((F2)fp)(a[0], a[1]);
+        case 3:
+            return ((F3)fp)(a[0], a[1], a[2]);
+        case 4:
+            return ((F4)fp)(a[0], a[1], a[2], a[3]);
+        case 5:
+            return ((F5)fp)(a[0], a[1], a[2], a[3], a[4]);
+        case 6:
+            return ((F6)fp)(a[0], a[1], a[2], a[3], a[4], a[5]);
+        case 7:
+            return ((F7)fp)(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+        default: // BytecodeCompiler::kMaxNativeArgs
+            return ((F8)fp)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+        }
+    }
+
+    const unsigned hotCalls_;
+    Hooks hooks_;
+    // by symbol id
+    std::vector<Slot> slots_;
+    std::vector<Frame> frames_;
+    std::vector<double> regs_;
+    InterpStats stats_;
+};
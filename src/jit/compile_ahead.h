@@ -0,0 +1,85 @@
+/*
+ * File: compile_ahead.h
+ * Path: /jit/compile_ahead.h
+ * Module: jit
+ * Lang: C/C++
+ * Created Date: Tuesday, October 20th 2026, 9:41:18 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file starts compiling definitions while the driver parses on.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "KaleidoSopceJIT.h"
+#include <llvm-18/llvm/IR/Module.h>
+#include <llvm-18/llvm/Support/DynamicLibrary.h>
+#include <llvm-18/llvm/Support/Error.h>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Pipelined JIT compilation (-compile-threads N). The JIT then materializes
+//  on a thread pool, and a definition added here is looked up right away
+//  without waiting, so it is optimized and compiled on the pool while the
+//  driver parses what follows. A top-level expression needs no special
+//  ordering: its blocking lookup waits in the ExecutionSession for the
+//  definitions it calls, whether they are being compiled already or not.
+//
+//  A definition that calls something not known yet (an extern to be
+//  defined later) is not started: its link would fail for good instead of
+//  waiting. It is compiled when something that calls it is looked up, as
+//  without this, but still on the pool.
+class CompileAhead {
+public:
+    explicit CompileAhead(llvm::orc::KaleidoscopeJIT &jit) : jit_(jit) {}
+
+    llvm::Error addDefinition(llvm::orc::ThreadSafeModule tsm) {
+        std::vector<std::string> defs;
+        bool known = true;
+        tsm.withModuleDo([&](llvm::Module &m) {
+            for (llvm::Function &fn : m) {
+                if (fn.isIntrinsic()) continue;
+                std::string name = fn.getName().str();
+                if (!fn.isDeclaration())
+                    defs.push_back(std::move(name));
+                else if (!defined_.count(name) && !inProcess(name))
+                    known = false;
+            }
+        });
+        if (auto err = jit_.addModule(std::move(tsm))) return err;
+        defined_.insert(defs.begin(), defs.end());
+        if (known && !defs.empty()) {
+            jit_.lookupAsync(defs);
+            ++started_;
+        } else {
+            ++deferred_;
+        }
+        return llvm::Error::success();
+    }
+
+    void printStats() const {
+        fprintf(stderr,
+                "compile-ahead: %zu definitions started while parsing, %zu "
+                "left to their first use\n",
+                started_, deferred_);
+    }
+
+private:
+    // what the JIT's DynamicLibrarySearchGenerator would find
+    static bool inProcess(const std::string &name) {
+        return llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(name) !=
+               nullptr;
+    }
+
+    llvm::orc::KaleidoscopeJIT &jit_;
+    // everything added so far
+    std::unordered_set<std::string> defined_;
+    size_t started_ = 0;
+    size_t deferred_ = 0;
+};
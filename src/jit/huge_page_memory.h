@@ -0,0 +1,437 @@
+/*
+ * File: huge_page_memory.h
+ * Path: /jit/huge_page_memory.h
+ * Module: jit
+ * Lang: C/C++
+ * Created Date: Thursday, October 22nd 2026, 9:41:17 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file packs the JIT's code and read-only data onto huge pages.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <llvm-18/llvm/ExecutionEngine/JITLink/JITLink.h>
+#include <llvm-18/llvm/ExecutionEngine/JITLink/JITLinkMemoryManager.h>
+#include <llvm-18/llvm/ExecutionEngine/Orc/Shared/AllocationActions.h>
+#include <llvm-18/llvm/Support/Error.h>
+#include <llvm-18/llvm/Support/Memory.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+// What HugePageMemoryManager did, for -stats
+struct JITMemoryStats {
+    size_t chunks = 0;
+    size_t explicitHuge = 0; // chunks on hugetlbfs pages
+    size_t advisedHuge = 0;  // chunks advised to transparent huge pages
+    size_t objects = 0;      // linked
+    // in use now
+    size_t codeBytes = 0;
+    size_t readOnlyBytes = 0;
+    size_t dataBytes = 0;
+
+    void print() const {
+        fprintf(stderr,
+                "jit-memory: %zu chunks (%zu on explicit huge pages, %zu "
+                "advised to transparent ones), %zu objects, %zu code, %zu "
+                "read-only and %zu data bytes in use\n",
+                chunks, explicitHuge, advisedHuge, objects, codeBytes,
+                readOnlyBytes, dataBytes);
+    }
+};
+
+// A JITLink memory manager (-jit-huge-pages) that packs the code and the
+//  read-only data of all objects together, on 2 MB pages when it can, so
+//  that thousands of small modules share a few iTLB entries instead of
+//  taking a 4 KB page of code each.
+//
+//  Memory comes in chunks reserved up front, each of three parts of the
+//  slab size, close enough together for the small code model: code, mapped
+//  read and execute; read-only data, mapped read only; and writable data,
+//  mapped read-write. Protections never change within the first two parts,
+//  which would split their huge pages: they map a memfd that JITLink writes
+//  through a second, writable mapping, the working memory of the segments.
+//  What is only needed while linking goes with the writable data, on pages
+//  of its own if it asks for other protections.
+//
+//  The memfd is on hugetlbfs pages if the pool has enough of them, and is
+//  otherwise advised to transparent huge pages, which the kernel gives to
+//  shared memory only as /sys/kernel/mm/transparent_hugepage/shmem_enabled
+//  allows. Without either, objects are still packed on ordinary pages.
+class HugePageMemoryManager : public llvm::jitlink::JITLinkMemoryManager {
+public:
+    static constexpr size_t kHugePage = 2 << 20;
+
+    explicit HugePageMemoryManager(size_t slabSize)
+        : partSize_(alignUp(std::max(slabSize, kHugePage), kHugePage)),
+          pageSize_((size_t)sysconf(_SC_PAGESIZE)) {}
+
+    HugePageMemoryManager(const HugePageMemoryManager &) = delete;
+    HugePageMemoryManager &operator=(const HugePageMemoryManager &) = delete;
+
+    using JITLinkMemoryManager::allocate;
+    using JITLinkMemoryManager::deallocate;
+
+    void allocate(const llvm::jitlink::JITLinkDylib *,
+                  llvm::jitlink::LinkGraph &g,
+                  OnAllocatedFunction onAllocated) override {
+        llvm::jitlink::BasicLayout layout(g);
+        std::vector<Piece> pieces;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!place(layout, pieces))
+                return onAllocated(llvm::make_error<llvm::StringError>(
+                    "cannot reserve JIT memory for " + g.getName() + ": " +
+                        strerror(errno),
+                    llvm::inconvertibleErrorCode()));
+        }
+        // memory may be reused
+        for (auto &[group, seg] : layout.segments())
+            memset(seg.WorkingMem + seg.ContentSize, 0, seg.ZeroFillSize);
+        if (auto err = layout.apply()) {
+            release(pieces);
+            return onAllocated(std::move(err));
+        }
+        onAllocated(std::make_unique<InFlight>(*this, g, std::move(pieces)));
+    }
+
+    void deallocate(std::vector<FinalizedAlloc> allocs,
+                    OnDeallocatedFunction onDeallocated) override {
+        llvm::Error err = llvm::Error::success();
+        for (FinalizedAlloc &alloc : allocs) {
+            auto *info = alloc.release().toPtr<FinalizedInfo *>();
+            err = llvm::joinErrors(
+                std::move(err),
+                llvm::orc::shared::runDeallocActions(info->deallocActions));
+            release(info->pieces);
+            delete info;
+        }
+        onDeallocated(std::move(err));
+    }
+
+    JITMemoryStats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    enum Part { Code, ReadOnly, Data, kNumParts };
+
+    // first fit over the free ranges of one part of a chunk, by offset
+    class FreeList {
+    public:
+        static constexpr size_t kNone = ~(size_t)0;
+
+        explicit FreeList(size_t size) { free_[0] = size; }
+
+        size_t alloc(size_t size, size_t align) {
+            for (auto it = free_.begin(); it != free_.end(); ++it) {
+                size_t start = alignUp(it->first, align);
+                size_t end = it->first + it->second;
+                if (start > end || end - start < size) continue;
+                size_t off = it->first;
+                free_.erase(it);
+                if (start != off) free_[off] = start - off;
+                if (start + size != end)
+                    free_[start + size] = end - start - size;
+                return start;
+            }
+            return kNone;
+        }
+
+        void release(size_t off, size_t size) {
+            auto next = free_.lower_bound(off);
+            if (next != free_.end() && off + size == next->first) {
+                size += next->second;
+                next = free_.erase(next);
+            }
+            if (next != free_.begin()) {
+                auto prev = std::prev(next);
+                if (prev->first + prev->second == off) {
+                    prev->second += size;
+                    return;
+                }
+            }
+            free_[off] = size;
+        }
+
+    private:
+        std::map<size_t, size_t> free_;
+    };
+
+    struct Chunk {
+        char *base = nullptr; // of the code part, the other two follow
+        char *work = nullptr; // writable mapping of code and read-only data
+        size_t partSize = 0;
+        int fd = -1;
+        std::vector<FreeList> free;
+
+        char *at(Part part, size_t off) const {
+            return base + part * partSize + off;
+        }
+
+        ~Chunk() {
+            if (work) munmap(work, 2 * partSize);
+            if (base) munmap(base, 3 * partSize);
+            if (fd >= 0) close(fd);
+        }
+    };
+
+    struct Piece {
+        Chunk *chunk;
+        Part part;
+        size_t off;
+        size_t size;
+        llvm::orc::MemProt prot;
+        bool finalizeOnly;
+
+        char *addr() const { return chunk->at(part, off); }
+    };
+
+    struct FinalizedInfo {
+        std::vector<Piece> pieces;
+        std::vector<llvm::orc::shared::WrapperFunctionCall> deallocActions;
+    };
+
+    class InFlight : public InFlightAlloc {
+    public:
+        InFlight(HugePageMemoryManager &mgr, llvm::jitlink::LinkGraph &g,
+                 std::vector<Piece> pieces)
+            : mgr_(mgr), g_(g), pieces_(std::move(pieces)) {}
+
+        void finalize(OnFinalizedFunction onFinalized) override {
+            for (const Piece &p : pieces_) {
+                if (ownPages(p.part, p.prot)) {
+                    if (std::error_code ec =
+                            llvm::sys::Memory::protectMappedMemory(
+                                {p.addr(), p.size},
+                                llvm::orc::toSysMemoryProtectionFlags(
+                                    p.prot))) {
+                        mgr_.release(pieces_);
+                        return onFinalized(llvm::errorCodeToError(ec));
+                    }
+                }
+                if (has(p.prot, llvm::orc::MemProt::Exec))
+                    llvm::sys::Memory::InvalidateInstructionCache(p.addr(),
+                                                                  p.size);
+            }
+            auto deallocActions =
+                llvm::orc::shared::runFinalizeActions(g_.allocActions());
+            if (!deallocActions) {
+                mgr_.release(pieces_);
+                return onFinalized(deallocActions.takeError());
+            }
+
+            auto *info = new FinalizedInfo{{}, std::move(*deallocActions)};
+            std::vector<Piece> linkOnly;
+            for (const Piece &p : pieces_)
+                (p.finalizeOnly ? linkOnly : info->pieces).push_back(p);
+            mgr_.release(linkOnly);
+            mgr_.finalized();
+            onFinalized(
+                FinalizedAlloc(llvm::orc::ExecutorAddr::fromPtr(info)));
+        }
+
+        void abandon(OnAbandonedFunction onAbandoned) override {
+            mgr_.release(pieces_);
+            onAbandoned(llvm::Error::success());
+        }
+
+    private:
+        HugePageMemoryManager &mgr_;
+        llvm::jitlink::LinkGraph &g_;
+        std::vector<Piece> pieces_;
+    };
+
+    static size_t alignUp(size_t v, size_t align) {
+        return (v + align - 1) / align * align;
+    }
+
+    // the bitmask operators of MemProt are for code in namespace llvm
+    static bool has(llvm::orc::MemProt prot, llvm::orc::MemProt flag) {
+        return (unsigned)prot & (unsigned)flag;
+    }
+
+    static Part partOf(llvm::orc::AllocGroup group) {
+        llvm::orc::MemProt prot = group.getMemProt();
+        if (group.getMemLifetime() == llvm::orc::MemLifetime::Finalize ||
+            has(prot, llvm::orc::MemProt::Write))
+            return Data;
+        return has(prot, llvm::orc::MemProt::Exec) ? Code : ReadOnly;
+    }
+
+    // The data part is mapped read-write, as most data stays: only the rest
+    //  gets pages of its own, to be protected as it asks
+    static bool ownPages(Part part, llvm::orc::MemProt prot) {
+        return part == Data &&
+               (unsigned)prot != ((unsigned)llvm::orc::MemProt::Read |
+                                  (unsigned)llvm::orc::MemProt::Write);
+    }
+
+    // the size and alignment of a segment in its part
+    void sizeOf(Part part, llvm::orc::MemProt prot,
+                const llvm::jitlink::BasicLayout::Segment &seg, size_t &size,
+                size_t &align) const {
+        // packed in units of 16 bytes
+        size_t unit = ownPages(part, prot) ? pageSize_ : 16;
+        size = alignUp(std::max<size_t>(seg.ContentSize + seg.ZeroFillSize,
+                                        1),
+                       unit);
+        align = std::max<size_t>(seg.Alignment.value(), unit);
+    }
+
+    // Finds room for every segment of layout, in a new chunk if none has
+    //  it. Mutex held.
+    bool place(llvm::jitlink::BasicLayout &layout,
+               std::vector<Piece> &pieces) {
+        for (auto &chunk : chunks_)
+            if (placeIn(*chunk, layout, pieces)) return true;
+        size_t need[kNumParts] = {0, 0, 0};
+        for (auto &[group, seg] : layout.segments()) {
+            Part part = partOf(group);
+            size_t size, align;
+            sizeOf(part, group.getMemProt(), seg, size, align);
+            need[part] = alignUp(need[part], align) + size + align;
+        }
+        size_t partSize = partSize_;
+        for (size_t n : need)
+            partSize = std::max(partSize, alignUp(n, kHugePage));
+        std::unique_ptr<Chunk> chunk = reserve(partSize);
+        if (!chunk) return false;
+        chunks_.push_back(std::move(chunk));
+        return placeIn(*chunks_.back(), layout, pieces);
+    }
+
+    bool placeIn(Chunk &chunk, llvm::jitlink::BasicLayout &layout,
+                 std::vector<Piece> &pieces) {
+        for (auto &[group, seg] : layout.segments()) {
+            Part part = partOf(group);
+            size_t size, align;
+            sizeOf(part, group.getMemProt(), seg, size, align);
+            size_t off = chunk.free[part].alloc(size, align);
+            if (off == FreeList::kNone) {
+                for (const Piece &p : pieces) releaseLocked(p);
+                pieces.clear();
+                return false;
+            }
+            pieces.push_back(
+                {&chunk, part, off, size, group.getMemProt(),
+                 group.getMemLifetime() == llvm::orc::MemLifetime::Finalize});
+            (part == Code       ? stats_.codeBytes
+             : part == ReadOnly ? stats_.readOnlyBytes
+                                : stats_.dataBytes) += size;
+            char *addr = chunk.at(part, off);
+            seg.Addr = llvm::orc::ExecutorAddr::fromPtr(addr);
+            seg.WorkingMem =
+                part == Data ? addr : chunk.work + part * chunk.partSize + off;
+        }
+        return true;
+    }
+
+    void release(const std::vector<Piece> &pieces) {
+        // writable again, for whatever goes there next
+        for (const Piece &p : pieces)
+            if (ownPages(p.part, p.prot))
+                mprotect(p.addr(), p.size, PROT_READ | PROT_WRITE);
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const Piece &p : pieces) releaseLocked(p);
+    }
+
+    void releaseLocked(const Piece &p) {
+        p.chunk->free[p.part].release(p.off, p.size);
+        (p.part == Code       ? stats_.codeBytes
+         : p.part == ReadOnly ? stats_.readOnlyBytes
+                              : stats_.dataBytes) -= p.size;
+    }
+
+    void finalized() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.objects;
+    }
+
+    // Maps a new chunk, on a huge page boundary, or returns nullptr with
+    //  errno set. Mutex held.
+    std::unique_ptr<Chunk> reserve(size_t partSize) {
+        size_t span = 3 * partSize + kHugePage;
+        void *raw = mmap(nullptr, span, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (raw == MAP_FAILED) return nullptr;
+        char *base = (char *)alignUp((uintptr_t)raw, kHugePage);
+        if (base != raw) munmap(raw, base - (char *)raw);
+        munmap(base + 3 * partSize, (char *)raw + span - (base + 3 * partSize));
+
+        auto chunk = std::make_unique<Chunk>();
+        chunk->base = base;
+        chunk->partSize = partSize;
+        // MFD_HUGE_2MB, the log2 of the page size as <linux/memfd.h> has it
+        constexpr unsigned kMfdHuge2MB = 21u << 26;
+        chunk->fd = memfd_create("kaleidoscope-jit",
+                                 MFD_CLOEXEC | MFD_HUGETLB | kMfdHuge2MB);
+        if (chunk->fd >= 0 && mapShared(*chunk)) {
+            ++stats_.explicitHuge;
+        } else {
+            if (chunk->fd >= 0) close(chunk->fd);
+            chunk->fd = memfd_create("kaleidoscope-jit", MFD_CLOEXEC);
+            if (chunk->fd < 0 || !mapShared(*chunk)) return nullptr;
+            if (madvise(chunk->work, 2 * partSize, MADV_HUGEPAGE) == 0 &&
+                madvise(base, 2 * partSize, MADV_HUGEPAGE) == 0)
+                ++stats_.advisedHuge;
+        }
+        if (mmap(chunk->at(Data, 0), partSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1,
+                 0) == MAP_FAILED)
+            return nullptr;
+        for (int part = 0; part != kNumParts; ++part)
+            chunk->free.emplace_back(partSize);
+        ++stats_.chunks;
+        return chunk;
+    }
+
+    // Maps the memfd of chunk over its code and read-only parts, and once
+    //  more writable. On failure the parts are reserved again, for another
+    //  try.
+    static bool mapShared(Chunk &chunk) {
+        size_t size = 2 * chunk.partSize;
+        if (ftruncate(chunk.fd, (off_t)size) == 0) {
+            chunk.work = (char *)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED, chunk.fd, 0);
+            if (chunk.work == (char *)MAP_FAILED) {
+                chunk.work = nullptr;
+            } else if (mmap(chunk.at(Code, 0), chunk.partSize,
+                            PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED,
+                            chunk.fd, 0) != MAP_FAILED &&
+                       mmap(chunk.at(ReadOnly, 0), chunk.partSize, PROT_READ,
+                            MAP_SHARED | MAP_FIXED, chunk.fd,
+                            (off_t)chunk.partSize) != MAP_FAILED) {
+                return true;
+            }
+        }
+        int err = errno;
+        if (chunk.work) munmap(chunk.work, size);
+        chunk.work = nullptr;
+        mmap(chunk.base, size, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+        errno = err;
+        return false;
+    }
+
+    const size_t partSize_;
+    const size_t pageSize_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Chunk>> chunks_;
+    JITMemoryStats stats_;
+};
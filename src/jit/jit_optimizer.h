@@ -0,0 +1,88 @@
+/*
+ * File: jit_optimizer.h
+ * Path: /jit/jit_optimizer.h
+ * Module: jit
+ * Lang: C/C++
+ * Created Date: Monday, October 19th 2026, 3:28:05 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file optimizes modules inside the JIT, when they get compiled.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "KaleidoSopceJIT.h"
+#include "opt_pipeline.h"
+#include <llvm-18/llvm/IR/Module.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// The IR pipeline of one level as the transform of the JIT's OptimizeLayer,
+//  for when a module is not optimized by the env that generates it (-lazy,
+//  -compile-threads): it then runs when the module is compiled, if ever.
+//  That is on whichever thread materializes it, maybe several at once, so
+//  each run takes a pipeline no other thread is using, building one more
+//  if they are all taken. There are never more than the threads that
+//  compile concurrently.
+class JITOptimizer {
+public:
+    explicit JITOptimizer(unsigned optLevel) : optLevel_(optLevel) {}
+
+    // installs this as jit's optimizer, which must not outlive it; the
+    //  pipelines tune for jit's target
+    void attach(llvm::orc::KaleidoscopeJIT &jit) {
+        jit_ = &jit;
+        jit.setOptimizer(
+            [this](llvm::orc::ThreadSafeModule tsm,
+                   const llvm::orc::MaterializationResponsibility &)
+                -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+                auto opt = acquire();
+                if (!opt) return opt.takeError();
+                tsm.withModuleDo([&opt](llvm::Module &m) { (*opt)->run(m); });
+                release(*opt);
+                return std::move(tsm);
+            });
+    }
+
+    // summed over the pipelines not running at the moment
+    OptStats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        OptStats stats;
+        for (OptPipeline *opt : idle_) stats += opt->getStats();
+        return stats;
+    }
+
+private:
+    llvm::Expected<OptPipeline *> acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!idle_.empty()) {
+                OptPipeline *opt = idle_.back();
+                idle_.pop_back();
+                return opt;
+            }
+        }
+        // set up out of the lock
+        auto tm = jit_->createTargetMachine();
+        if (!tm) return tm.takeError();
+        auto opt = std::make_unique<OptPipeline>(optLevel_, std::move(*tm));
+        std::lock_guard<std::mutex> lock(mutex_);
+        all_.push_back(std::move(opt));
+        return all_.back().get();
+    }
+
+    void release(OptPipeline *opt) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(opt);
+    }
+
+    const unsigned optLevel_;
+    llvm::orc::KaleidoscopeJIT *jit_ = nullptr;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<OptPipeline>> all_;
+    std::vector<OptPipeline *> idle_;
+};
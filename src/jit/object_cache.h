@@ -0,0 +1,192 @@
+/*
+ * File: object_cache.h
+ * Path: /jit/object_cache.h
+ * Module: jit
+ * Lang: C/C++
+ * Created Date: Tuesday, October 20th 2026, 2:06:44 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file keeps the JIT's object files on disk between runs.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "KaleidoSopceJIT.h"
+#include <llvm-18/llvm/ADT/ArrayRef.h>
+#include <llvm-18/llvm/ADT/SmallString.h>
+#include <llvm-18/llvm/ADT/SmallVector.h>
+#include <llvm-18/llvm/ADT/StringExtras.h>
+#include <llvm-18/llvm/Bitcode/BitcodeWriter.h>
+#include <llvm-18/llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm-18/llvm/IR/Module.h>
+#include <llvm-18/llvm/Support/FileSystem.h>
+#include <llvm-18/llvm/Support/MemoryBuffer.h>
+#include <llvm-18/llvm/Support/SHA256.h>
+#include <llvm-18/llvm/Support/raw_ostream.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What DiskObjectCache did, for -stats
+struct ObjectCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t stored = 0;
+    size_t failed = 0; // objects that could not be written
+    size_t bytesLoaded = 0;
+    size_t bytesStored = 0;
+
+    void print() const {
+        fprintf(stderr,
+                "object-cache: %zu hits (%zu bytes), %zu misses, %zu stored "
+                "(%zu bytes), %zu failed\n",
+                hits, bytesLoaded, misses, stored, bytesStored, failed);
+    }
+};
+
+// The JIT's object files in a directory (-cache-dir), one file per module
+//  named by the SHA-256 of its bitcode and of the target it is compiled
+//  for: triple, CPU, features and codegen level. The bitcode is hashed as
+//  it reaches the compiler, after the IR pipeline, so the IR optimization
+//  level is in it already, and so is anything else that changes the code.
+//  Only a key computed on a miss is written to: codegen changes the module
+//  it compiles, so the key is taken before that and found again by module.
+//
+//  A file is written under a temporary name and renamed, so that
+//  concurrent runs sharing the directory never see half an object. Nothing
+//  is ever evicted.
+class DiskObjectCache {
+public:
+    explicit DiskObjectCache(std::string dir) : dir_(std::move(dir)) {
+        if (std::error_code ec = llvm::sys::fs::create_directories(dir_))
+            error_ = ec.message();
+    }
+
+    DiskObjectCache(const DiskObjectCache &) = delete;
+    DiskObjectCache &operator=(const DiskObjectCache &) = delete;
+
+    // empty if the directory is usable
+    const std::string &getError() const __attribute__((always_inline)) {
+        return error_;
+    }
+
+    // for KaleidoscopeJITConfig::CacheFor
+    llvm::ObjectCache *forTarget(const llvm::orc::JITTargetMachineBuilder &jtmb,
+                                 llvm::CodeGenOptLevel level) {
+        std::string target = jtmb.getTargetTriple().str() + '\0' +
+                             jtmb.getCPU() + '\0' +
+                             jtmb.getFeatures().getString() + '\0' +
+                             std::to_string((int)level);
+        std::lock_guard<std::mutex> lock(mutex_);
+        targets_.push_back(std::make_unique<TargetCache>(*this, target));
+        return targets_.back().get();
+    }
+
+    ObjectCacheStats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    // the objects of one target; the JIT has a compile layer per target
+    class TargetCache : public llvm::ObjectCache {
+    public:
+        TargetCache(DiskObjectCache &disk, std::string target)
+            : disk_(disk), target_(std::move(target)) {}
+
+        std::unique_ptr<llvm::MemoryBuffer>
+        getObject(const llvm::Module *m) override {
+            return disk_.load(*m, target_);
+        }
+
+        void notifyObjectCompiled(const llvm::Module *m,
+                                  llvm::MemoryBufferRef obj) override {
+            disk_.store(m, obj);
+        }
+
+    private:
+        DiskObjectCache &disk_;
+        const std::string target_;
+    };
+
+    static std::string keyOf(const llvm::Module &m,
+                             const std::string &target) {
+        llvm::SmallVector<char, 0> bytes;
+        llvm::raw_svector_ostream os(bytes);
+        os << target << '\0';
+        llvm::WriteBitcodeToFile(m, os);
+        auto digest = llvm::SHA256::hash(llvm::ArrayRef<uint8_t>(
+            reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size()));
+        return llvm::toHex(digest, /*LowerCase=*/true);
+    }
+
+    std::string pathOf(const std::string &key) const {
+        return dir_ + "/" + key + ".o";
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> load(const llvm::Module &m,
+                                             const std::string &target) {
+        std::string key = keyOf(m, target);
+        auto buf = llvm::MemoryBuffer::getFile(pathOf(key), /*IsText=*/false,
+                                               /*RequiresNullTerminator=*/
+                                               false);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!buf) {
+            ++stats_.misses;
+            pending_[&m] = std::move(key);
+            return nullptr;
+        }
+        ++stats_.hits;
+        stats_.bytesLoaded += (*buf)->getBufferSize();
+        return std::move(*buf);
+    }
+
+    void store(const llvm::Module *m, llvm::MemoryBufferRef obj) {
+        std::string key;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = pending_.find(m);
+            if (found == pending_.end()) return;
+            key = std::move(found->second);
+            pending_.erase(found);
+        }
+
+        int fd;
+        llvm::SmallString<128> tmp;
+        bool ok = !llvm::sys::fs::createUniqueFile(dir_ + "/%%%%%%%%.tmp", fd,
+                                                   tmp);
+        if (ok) {
+            llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+            os << obj.getBuffer();
+            os.close();
+            ok = !os.has_error();
+            os.clear_error();
+            ok = ok && !llvm::sys::fs::rename(tmp, pathOf(key));
+            if (!ok) llvm::sys::fs::remove(tmp);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ok) {
+            ++stats_.failed;
+            return;
+        }
+        ++stats_.stored;
+        stats_.bytesStored += obj.getBufferSize();
+    }
+
+    const std::string dir_;
+    std::string error_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<TargetCache>> targets_;
+    // key of each module that missed, until its object is compiled
+    std::unordered_map<const llvm::Module *, std::string> pending_;
+    ObjectCacheStats stats_;
+};
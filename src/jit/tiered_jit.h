@@ -0,0 +1,319 @@
+/*
+ * File: tiered_jit.h
+ * Path: /jit/tiered_jit.h
+ * Module: jit
+ * Lang: C/C++
+ * Created Date: Monday, October 19th 2026, 10:12:36 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file compiles definitions fast first, and the hot ones again well.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "KaleidoSopceJIT.h"
+#include "opt_pipeline.h"
+#include <llvm-18/llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm-18/llvm/ExecutionEngine/Orc/Shared/ExecutorAddress.h>
+#include <llvm-18/llvm/IR/Constants.h>
+#include <llvm-18/llvm/IR/GlobalVariable.h>
+#include <llvm-18/llvm/IR/IRBuilder.h>
+#include <llvm-18/llvm/IR/Module.h>
+#include <llvm-18/llvm/Support/Error.h>
+#include <llvm-18/llvm/Support/raw_ostream.h>
+#include <llvm-18/llvm/Transforms/Utils/Cloning.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// What TieredJIT did, for -stats
+struct TierStats {
+    size_t definitions = 0; // compiled at tier 0
+    size_t hot = 0;         // reached the call threshold
+    size_t promoted = 0;    // tier 1 swapped in
+    double tier0Seconds = 0;
+    double tier1Seconds = 0; // on the background thread
+    OptStats opt;            // of tier 1
+
+    void print(unsigned hotCalls) const {
+        fprintf(stderr,
+                "tiered: %zu definitions at tier 0 in %.2f ms, %zu hot "
+                "(%u calls), %zu promoted to tier 1 in %.2f ms\n",
+                definitions, tier0Seconds * 1e3, hot, hotCalls, promoted,
+                tier1Seconds * 1e3);
+        opt.print();
+    }
+};
+
+// Two-tier compilation of definitions for the JIT driver (-tiered).
+//
+//  Tier 0 is the definition as generated, no IR pipeline, through the JIT's
+//  FastCompileLayer. Its function is renamed to "f$t0.<id>" and every call
+//  to f, recursive ones included, goes to f, which is an indirection stub
+//  jumping to the current body. At its entry the body bumps a call counter
+//  of its own; the call that reaches hotCalls queues the definition for
+//  tier 1, once.
+//
+//  Tier 1 is the definition as generated, cloned before the instrumentation,
+//  run through the -O3 pipeline and the optimizing CompileLayer on a
+//  background thread as "f$t1.<id>", then swapped in by rewriting the
+//  stub's pointer, which is one aligned store. Calls already running finish
+//  in tier 0 and the next one through the stub gets tier 1; calls within
+//  tier 1 are direct, so a recursion stays there.
+//
+//  A redefinition of f compiles a new tier 0 and points the stub at it; a
+//  promotion of the old one still in flight is then dropped.
+//  Top-level expressions run once and are only ever compiled at tier 0.
+class TieredJIT {
+public:
+    TieredJIT(llvm::orc::KaleidoscopeJIT &jit, unsigned hotCalls)
+        : jit_(jit), hotCalls_(hotCalls),
+          stubs_(llvm::orc::createLocalIndirectStubsManagerBuilder(
+              jit.getTargetTriple())()) {
+        // what the tier 0 code calls when it becomes hot
+        llvm::orc::SymbolMap hook;
+        hook[jit_.mangle(kTierUpHook)] = llvm::orc::ExecutorSymbolDef(
+            llvm::orc::ExecutorAddr::fromPtr(&TieredJIT::tierUp),
+            llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+        llvm::cantFail(jit_.getMainJITDylib().define(
+            llvm::orc::absoluteSymbols(std::move(hook))));
+        worker_ = std::thread([this] { work(); });
+    }
+
+    // drops the promotions still queued, waits for the one in flight
+    ~TieredJIT() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wakeup_.notify_one();
+        worker_.join();
+    }
+
+    TieredJIT(const TieredJIT &) = delete;
+    TieredJIT &operator=(const TieredJIT &) = delete;
+
+    // compiles the definition in tsm at tier 0 and makes its name call it
+    llvm::Error addDefinition(llvm::orc::ThreadSafeModule tsm) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::string name;
+        llvm::orc::ThreadSafeModule copy;
+        tsm.withModuleDo([&](llvm::Module &m) {
+            for (llvm::Function &fn : m)
+                if (!fn.isDeclaration()) {
+                    name = fn.getName().str();
+                    break;
+                }
+            if (!name.empty())
+                copy = llvm::orc::ThreadSafeModule(llvm::CloneModule(m),
+                                                   tsm.getContext());
+        });
+        if (name.empty()) return jit_.addModuleFast(std::move(tsm));
+
+        uint64_t id;
+        bool fresh;
+        // the copy kept for the definition this one replaces, which is
+        //  never promoted now; freed out of the lock, context and all
+        llvm::orc::ThreadSafeModule stale;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            id = funcs_.size();
+            funcs_.push_back({name, llvm::orc::ThreadSafeModule()});
+            auto found = current_.find(name);
+            fresh = found == current_.end();
+            if (!fresh) stale = std::move(funcs_[found->second].pending);
+            current_[name] = id;
+        }
+        // The body calls the stub, so the stub has to be there before the
+        //  body is linked, and points nowhere until it is. Nothing can call
+        //  it in between.
+        if (fresh) {
+            if (auto err = stubs_->createStub(
+                    name, llvm::orc::ExecutorAddr(),
+                    llvm::JITSymbolFlags::Exported |
+                        llvm::JITSymbolFlags::Callable))
+                return err;
+            llvm::orc::SymbolMap stub;
+            stub[jit_.mangle(name)] = stubs_->findStub(name, false);
+            if (auto err = jit_.getMainJITDylib().define(
+                    llvm::orc::absoluteSymbols(std::move(stub))))
+                return err;
+        }
+
+        std::string body = name + "$t0." + std::to_string(id);
+        tsm.withModuleDo(
+            [&](llvm::Module &m) { instrument(m, name, body, id); });
+        if (auto err = jit_.addModuleFast(std::move(tsm))) return err;
+        auto sym = jit_.lookup(body);
+        if (!sym) return sym.takeError();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        funcs_[id].pending = std::move(copy);
+        if (auto err = stubs_->updatePointer(name, sym->getAddress()))
+            return err;
+        ++stats_.definitions;
+        stats_.tier0Seconds += secondsSince(t0);
+        return llvm::Error::success();
+    }
+
+    // a top-level expression, to be removed with rt after it ran
+    llvm::Error addExpression(llvm::orc::ThreadSafeModule tsm,
+                              llvm::orc::ResourceTrackerSP rt) {
+        return jit_.addModuleFast(std::move(tsm), std::move(rt));
+    }
+
+    void printStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.print(hotCalls_);
+    }
+
+private:
+    static constexpr const char *kTierUpHook = "__kaleido_tier_up";
+
+    // a definition compiled at tier 0, by id
+    struct Definition {
+        std::string name;
+        // the module as generated, until it is promoted
+        llvm::orc::ThreadSafeModule pending;
+    };
+
+    // called from the tier 0 code of definition id on its hotCalls-th call
+    static void tierUp(TieredJIT *self, uint64_t id) {
+        {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            self->queue_.push_back(id);
+            ++self->stats_.hot;
+        }
+        self->wakeup_.notify_one();
+    }
+
+    // Renames the definition of name to body, sends all its calls,
+    //  recursive ones included, through the stub, and counts its calls:
+    //
+    //    count: %n = add (load @name.calls), 1
+    //           store %n, @name.calls
+    //           br (%n == hotCalls), hot, entry
+    //    hot:   call __kaleido_tier_up(this, id)
+    //           br entry
+    void instrument(llvm::Module &m, const std::string &name,
+                    const std::string &body, uint64_t id) {
+        llvm::Function *fn = m.getFunction(name);
+        fn->setName(body);
+        llvm::Function *stub =
+            llvm::Function::Create(fn->getFunctionType(),
+                                   llvm::Function::ExternalLinkage, name, m);
+        fn->replaceAllUsesWith(stub);
+
+        llvm::LLVMContext &ctx = m.getContext();
+        llvm::IRBuilder<> b(ctx);
+        auto *calls = new llvm::GlobalVariable(
+            m, b.getInt64Ty(), false, llvm::GlobalValue::InternalLinkage,
+            b.getInt64(0), name + ".calls");
+        llvm::BasicBlock *entry = &fn->getEntryBlock();
+        auto *count = llvm::BasicBlock::Create(ctx, "count", fn, entry);
+        auto *hot = llvm::BasicBlock::Create(ctx, "hot", fn, entry);
+
+        b.SetInsertPoint(count);
+        llvm::Value *n = b.CreateAdd(b.CreateLoad(b.getInt64Ty(), calls),
+                                     b.getInt64(1));
+        b.CreateStore(n, calls);
+        b.CreateCondBr(b.CreateICmpEQ(n, b.getInt64(hotCalls_)), hot, entry);
+
+        b.SetInsertPoint(hot);
+        llvm::Type *ptr = llvm::PointerType::getUnqual(ctx);
+        llvm::FunctionCallee hook = m.getOrInsertFunction(
+            kTierUpHook, b.getVoidTy(), ptr, b.getInt64Ty());
+        b.CreateCall(hook,
+                     {b.CreateIntToPtr(b.getInt64((uintptr_t)this), ptr),
+                      b.getInt64(id)});
+        b.CreateBr(entry);
+    }
+
+    // the background thread: promotes the hot definitions as they come
+    void work() {
+        // for the JIT's target; the generic costs if it cannot be had
+        auto tm = jit_.createTargetMachine();
+        if (!tm)
+            llvm::logAllUnhandledErrors(tm.takeError(), llvm::errs(),
+                                        "tier 1: ");
+        OptPipeline opt(3, tm ? std::move(*tm) : nullptr);
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wakeup_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (stop_) return;
+            uint64_t id = queue_.front();
+            queue_.pop_front();
+            std::string name = funcs_[id].name;
+            // redefined since
+            if (current_[name] != id || !funcs_[id].pending) continue;
+            llvm::orc::ThreadSafeModule tsm = std::move(funcs_[id].pending);
+            lock.unlock();
+
+            auto t0 = std::chrono::steady_clock::now();
+            auto addr = compileTier1(std::move(tsm), name, id, opt);
+            double dt = secondsSince(t0);
+
+            lock.lock();
+            stats_.tier1Seconds += dt;
+            stats_.opt = opt.getStats();
+            if (!addr) {
+                llvm::logAllUnhandledErrors(addr.takeError(), llvm::errs(),
+                                            "tier 1: ");
+                continue;
+            }
+            if (current_[name] != id) continue;
+            if (auto err = stubs_->updatePointer(name, *addr)) {
+                llvm::logAllUnhandledErrors(std::move(err), llvm::errs(),
+                                            "tier 1: ");
+                continue;
+            }
+            ++stats_.promoted;
+        }
+    }
+
+    llvm::Expected<llvm::orc::ExecutorAddr>
+    compileTier1(llvm::orc::ThreadSafeModule tsm, const std::string &name,
+                 uint64_t id, OptPipeline &opt) {
+        std::string body = name + "$t1." + std::to_string(id);
+        tsm.withModuleDo([&](llvm::Module &m) {
+            m.getFunction(name)->setName(body);
+            opt.run(m);
+        });
+        if (auto err = jit_.addModule(std::move(tsm))) return std::move(err);
+        auto sym = jit_.lookup(body);
+        if (!sym) return sym.takeError();
+        return sym->getAddress();
+    }
+
+    static double secondsSince(std::chrono::steady_clock::time_point t0) {
+        std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        return dt.count();
+    }
+
+    llvm::orc::KaleidoscopeJIT &jit_;
+    const unsigned hotCalls_;
+    std::unique_ptr<llvm::orc::IndirectStubsManager> stubs_;
+
+    // guards everything below, and the stub pointers
+    mutable std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::deque<Definition> funcs_;
+    // name -> id of its latest definition
+    std::unordered_map<std::string, uint64_t> current_;
+    std::deque<uint64_t> queue_;
+    bool stop_ = false;
+    TierStats stats_;
+    std::thread worker_;
+};
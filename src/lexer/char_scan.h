@@ -0,0 +1,234 @@
+/*
+ * File: char_scan.h
+ * Path: /lexer/char_scan.h
+ * Module: lexer
+ * Lang: C/C++
+ * Created Date: Friday, October 16th 2026, 2:20:41 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file implements the character classification and run scanning
+    used by the buffer mode of the lexer.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+
+// The SIMD path is picked at compile time from the target flags: build with
+//  -mavx2 (or -march=native) for 32-byte blocks, SSE2 is the x86-64 baseline.
+//  Define KS_LEXER_NO_SIMD to force the scalar loops.
+#if !defined(KS_LEXER_NO_SIMD) && defined(__AVX2__)
+#define KS_LEXER_AVX2 1
+#define KS_LEXER_ISA avx2
+#include <immintrin.h>
+#elif !defined(KS_LEXER_NO_SIMD) && defined(__SSE2__)
+#define KS_LEXER_SSE2 1
+#define KS_LEXER_ISA sse2
+#include <emmintrin.h>
+#else
+#define KS_LEXER_ISA scalar
+#endif
+
+namespace charscan {
+
+// All scanners may read up to kBlock bytes past the position they stop at, so
+//  the buffer needs that much readable padding after its end.
+constexpr unsigned kBlock = 32;
+
+enum CharClass : uint8_t {
+    ccSpace = 1 << 0,
+    ccAlpha = 1 << 1,
+    ccDigit = 1 << 2,
+    ccDot = 1 << 3,
+};
+
+struct CharTable {
+    uint8_t cls[256] = {};
+    constexpr CharTable() {
+        // same set as std::isspace in the "C" locale
+        for (int c : {' ', '\t', '\n', '\v', '\f', '\r'}) cls[c] = ccSpace;
+        for (int c = 'a'; c <= 'z'; ++c) cls[c] = ccAlpha;
+        for (int c = 'A'; c <= 'Z'; ++c) cls[c] = ccAlpha;
+        for (int c = '0'; c <= '9'; ++c) cls[c] = ccDigit;
+        cls[(int)'.'] = ccDot;
+    }
+};
+inline constexpr CharTable kTable{};
+
+inline bool is(char c, uint8_t mask) {
+    return kTable.cls[(unsigned char)c] & mask;
+}
+
+// The scanners are named after the instruction set they are built for, so
+//  translation units built with other flags (lexer_bench has one per set)
+//  get their own copy instead of breaking the one definition rule.
+inline namespace KS_LEXER_ISA {
+
+// ---------------------------------------------------------------------------
+// Block predicates: each returns a bitmask with bit i set when byte i of the
+//  block belongs to the run being scanned.
+#if defined(KS_LEXER_AVX2)
+using Block = __m256i;
+inline Block load(const char *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+inline uint32_t toMask(Block v) { return (uint32_t)_mm256_movemask_epi8(v); }
+inline Block eq(Block v, char c) {
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+// lo <= v <= hi for ASCII bounds; bytes >= 0x80 compare as negative and fail
+inline Block inRange(Block v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+inline Block bor(Block a, Block b) { return _mm256_or_si256(a, b); }
+inline Block lower(Block v) {
+    return _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+}
+#elif defined(KS_LEXER_SSE2)
+using Block = __m128i;
+inline Block load(const char *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+inline uint32_t toMask(Block v) { return (uint32_t)_mm_movemask_epi8(v); }
+inline Block eq(Block v, char c) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); }
+inline Block inRange(Block v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), v));
+}
+inline Block bor(Block a, Block b) { return _mm_or_si128(a, b); }
+inline Block lower(Block v) { return _mm_or_si128(v, _mm_set1_epi8(0x20)); }
+#endif
+
+#if defined(KS_LEXER_AVX2) || defined(KS_LEXER_SSE2)
+constexpr unsigned kWidth = sizeof(Block);
+constexpr uint32_t kFull = kWidth == 32 ? 0xffffffffu : 0xffffu;
+
+// Most identifiers, numbers and blanks are a few bytes long, and a block
+//  costs more than that many table lookups: a run is scanned a byte at a
+//  time, and a block at a time only once it is kShortRun bytes long.
+constexpr unsigned kShortRun = 16;
+
+// advance p while byte(*p) holds, then by whole blocks while the predicate
+//  holds for them, and finish with the position of the first byte that
+//  failed it
+template <typename Byte, typename Pred>
+inline const char *scanWhile(const char *p, Byte byte, Pred f) {
+    // unrolled, so the byte loop does not test for the end of the prefix
+#pragma GCC unroll 16
+    for (unsigned i = 0; i != kShortRun; ++i)
+        if (!byte(p[i])) return p + i;
+    p += kShortRun;
+    while (true) {
+        uint32_t m = f(load(p)) & kFull;
+        if (m != kFull) return p + __builtin_ctz(~m);
+        p += kWidth;
+    }
+}
+
+inline uint32_t spaceMask(Block v) {
+    // '\t' '\n' '\v' '\f' '\r' are 0x09..0x0d
+    return toMask(bor(eq(v, ' '), inRange(v, '\t', '\r')));
+}
+inline uint32_t alnumMask(Block v) {
+    return toMask(bor(inRange(lower(v), 'a', 'z'), inRange(v, '0', '9')));
+}
+inline uint32_t numberMask(Block v) {
+    return toMask(bor(inRange(v, '0', '9'), eq(v, '.')));
+}
+inline uint32_t notLineEndMask(Block v) {
+    return ~toMask(bor(bor(eq(v, '\n'), eq(v, '\r')), eq(v, '\0')));
+}
+#endif
+
+// ---------------------------------------------------------------------------
+inline const char *skipSpace(const char *p) {
+#if defined(KS_LEXER_AVX2) || defined(KS_LEXER_SSE2)
+    return scanWhile(p, [](char c) { return is(c, ccSpace); }, spaceMask);
+#else
+    while (is(*p, ccSpace)) ++p;
+    return p;
+#endif
+}
+
+// [a-zA-Z0-9]*
+inline const char *skipAlnum(const char *p) {
+#if defined(KS_LEXER_AVX2) || defined(KS_LEXER_SSE2)
+    return scanWhile(
+        p, [](char c) { return is(c, ccAlpha | ccDigit); }, alnumMask);
+#else
+    while (is(*p, ccAlpha | ccDigit)) ++p;
+    return p;
+#endif
+}
+
+// [0-9.]*
+inline const char *skipNumber(const char *p) {
+#if defined(KS_LEXER_AVX2) || defined(KS_LEXER_SSE2)
+    return scanWhile(
+        p, [](char c) { return is(c, ccDigit | ccDot); }, numberMask);
+#else
+    while (is(*p, ccDigit | ccDot)) ++p;
+    return p;
+#endif
+}
+
+// stops at '\n', '\r' or '\0'; the caller tells an embedded NUL from the end
+inline const char *findLineEnd(const char *p) {
+#if defined(KS_LEXER_AVX2) || defined(KS_LEXER_SSE2)
+    return scanWhile(
+        p, [](char c) { return c != '\n' && c != '\r' && c != '\0'; },
+        notLineEndMask);
+#else
+    while (*p != '\n' && *p != '\r' && *p != '\0') ++p;
+    return p;
+#endif
+}
+
+} // namespace KS_LEXER_ISA
+
+// ---------------------------------------------------------------------------
+// Parses a [0-9.]* literal the way strtod does: the longest prefix that is a
+//  decimal number, 0 if there is none.
+//  Up to 19 significant digits with a mantissa below 2^53 and at most 22
+//  fraction digits, m / 10^k is exact in both operands, so one division gives
+//  the correctly rounded result (Clinger's fast path). Everything else goes
+//  to std::from_chars, which is an Eisel-Lemire implementation in libstdc++,
+//  except what is out of a double's range: from_chars leaves that alone,
+//  strtod gives HUGE_VAL (inf) for it, or 0 if it is too small.
+inline double parseNumber(const char *first, const char *last) {
+    static constexpr double kPow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char *p = first;
+    uint64_t mantissa = 0;
+    int digits = 0, fraction = 0;
+    for (; p != last && *p != '.'; ++p, ++digits)
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    if (p != last) {
+        // the first '.' belongs to the number, a second one ends it
+        for (++p; p != last && *p != '.'; ++p, ++digits, ++fraction)
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    }
+    if (digits == 0) return 0.0;
+
+    if (digits <= 19 && mantissa <= (1ull << 53) && fraction <= 22)
+        return (double)mantissa / kPow10[fraction];
+
+    double value = 0.0;
+    if (std::from_chars(first, p, value).ec != std::errc::result_out_of_range)
+        return value;
+    // too large if it has a nonzero integer part, else too small
+    for (const char *q = first; q != p && *q != '.'; ++q)
+        if (*q != '0') return HUGE_VAL;
+    return 0.0;
+}
+
+} // namespace charscan
@@ -0,0 +1,107 @@
+/*
+ * File: interner.cpp
+ * Path: /lexer/interner.cpp
+ * Module: lexer
+ * Lang: C/C++
+ * Created Date: Saturday, October 17th 2026, 9:48:52 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file implements the global identifier table.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#include "interner.h"
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+Interner &Interner::global() {
+    static Interner instance;
+    return instance;
+}
+
+Interner::Interner()
+    : chunks_(std::make_unique<std::atomic<std::string_view *>[]>(
+          kMaxChunks)) {
+    for (size_t i = 0; i != kMaxChunks; ++i) chunks_[i].store(nullptr);
+    for (auto &op : binaryOps_) op.store(kNoSymbol);
+    for (auto &op : unaryOps_) op.store(kNoSymbol);
+
+    // must match the order of WellKnown
+    for (const char *s : {"def", "extern", "if", "then", "else", "for", "do",
+                          "binary", "unary", "__anon_expr"})
+        intern(s);
+    assert(ids_.size() == symAnonExpr + 1);
+}
+
+// Source files reuse a small working set of names over and over. A per-thread
+//  direct-mapped cache of recent lookups answers those without the lock; the
+//  cached views point into the table's own text, which never moves.
+namespace {
+struct RecentSymbol {
+    std::string_view text;
+    SymbolId id = kNoSymbol;
+};
+constexpr size_t kRecentSize = 1024;
+thread_local RecentSymbol recentSymbols[kRecentSize];
+} // namespace
+
+SymbolId Interner::intern(std::string_view s) {
+    size_t hash = std::hash<std::string_view>()(s);
+    RecentSymbol &recent = recentSymbols[hash & (kRecentSize - 1)];
+    if (recent.id != kNoSymbol && recent.text == s) return recent.id;
+
+    SymbolId id = internLocked(s);
+    recent = {str(id), id};
+    return id;
+}
+
+SymbolId Interner::internLocked(std::string_view s) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = ids_.find(s);
+    if (found != ids_.end()) return found->second;
+
+    // copy the text into a block that lives as long as the table
+    if (textLeft_ < s.size()) {
+        size_t blockSize = s.size() > 4096 ? s.size() : 4096;
+        textBlocks_.push_back(std::make_unique<char[]>(blockSize));
+        textCur_ = textBlocks_.back().get();
+        textLeft_ = blockSize;
+    }
+    std::string_view text(textCur_, s.size());
+    std::memcpy(textCur_, s.data(), s.size());
+    textCur_ += s.size();
+    textLeft_ -= s.size();
+
+    size_t id = size_.load(std::memory_order_relaxed);
+    size_t chunk = id >> kChunkBits;
+    if (chunk == kMaxChunks) {
+        fprintf(stderr, "Error: too many distinct identifiers\n");
+        std::abort();
+    }
+    if ((id & (kChunkSize - 1)) == 0) {
+        chunkStorage_.push_back(std::make_unique<std::string_view[]>(kChunkSize));
+        chunks_[chunk].store(chunkStorage_.back().get(),
+                             std::memory_order_release);
+    }
+    chunkStorage_[chunk][id & (kChunkSize - 1)] = text;
+    ids_.emplace(text, (SymbolId)id);
+    size_.store(id + 1, std::memory_order_release);
+    return (SymbolId)id;
+}
+
+SymbolId Interner::opSymbol(std::atomic<SymbolId> *cache, const char *prefix,
+                            char op) {
+    std::atomic<SymbolId> &slot = cache[(unsigned char)op];
+    SymbolId id = slot.load(std::memory_order_acquire);
+    if (id != kNoSymbol) return id;
+    id = intern(std::string(prefix) + op);
+    slot.store(id, std::memory_order_release);
+    return id;
+}
@@ -0,0 +1,88 @@
+/*
+ * File: interner.h
+ * Path: /lexer/interner.h
+ * Module: lexer
+ * Lang: C/C++
+ * Created Date: Saturday, October 17th 2026, 9:48:52 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file is the header of interner.cpp.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Stable integer id of an interned identifier. Ids are dense, starting at 0,
+//  so they can index plain arrays.
+using SymbolId = uint32_t;
+constexpr SymbolId kNoSymbol = ~(SymbolId)0;
+
+// Process-wide identifier table. The lexer interns every identifier once and
+//  everything after it (AST, prototypes, codegen tables) works on SymbolIds.
+//  intern() takes a lock; str() is lock-free and may run on any thread that
+//  got the id from intern() (directly or through some synchronization).
+class Interner {
+public:
+    // the first symbols are fixed, keywords first, in this order
+    enum WellKnown : SymbolId {
+        symDef,
+        symExtern,
+        symIf,
+        symThen,
+        symElse,
+        symFor,
+        symDo,
+        symBinary,
+        symUnary,
+        kNumKeywords,
+        symAnonExpr = kNumKeywords,
+    };
+
+    static Interner &global();
+
+    SymbolId intern(std::string_view s);
+    std::string_view str(SymbolId id) const {
+        return chunks_[id >> kChunkBits].load(std::memory_order_acquire)
+            [id & (kChunkSize - 1)];
+    }
+
+    // "binary" + op / "unary" + op, the names of user defined operators
+    SymbolId binaryOp(char op) { return opSymbol(binaryOps_, "binary", op); }
+    SymbolId unaryOp(char op) { return opSymbol(unaryOps_, "unary", op); }
+
+    size_t size() const { return size_.load(std::memory_order_acquire); }
+
+private:
+    Interner();
+    SymbolId internLocked(std::string_view s);
+    SymbolId opSymbol(std::atomic<SymbolId> *cache, const char *prefix,
+                      char op);
+
+    static constexpr unsigned kChunkBits = 12;
+    static constexpr size_t kChunkSize = size_t(1) << kChunkBits;
+    static constexpr size_t kMaxChunks = 4096;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string_view, SymbolId> ids_;
+    // id -> text, in fixed-size chunks that never move once published
+    std::unique_ptr<std::atomic<std::string_view *>[]> chunks_;
+    std::vector<std::unique_ptr<std::string_view[]>> chunkStorage_;
+    // the characters of all symbols
+    std::vector<std::unique_ptr<char[]>> textBlocks_;
+    char *textCur_ = nullptr;
+    size_t textLeft_ = 0;
+    std::atomic<size_t> size_{0};
+
+    std::atomic<SymbolId> binaryOps_[256];
+    std::atomic<SymbolId> unaryOps_[256];
+};
@@ -14,26 +14,44 @@
    /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
  */
 #include "lexer.h"
+#include "char_scan.h"
 #include "token.h"
+#include <cassert>
 #include <cctype>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 
-inline std::unordered_map<std::string, Token> Lexer::tokenTable_{
-    {"def", tokDef},
-    {"extern", tokExtern},
-    {"if", tokIf},
-    {"then", tokThen},
-    {"else", tokElse},
-    {"for", tokFor},
-    {"do", tokDo},
-    {"binary", tokBinary},
-    {"unary", tokUnary},
-}; 
+// keywords are the first symbols of the interner, indexed by their SymbolId
+static constexpr Token keywordTokens[Interner::kNumKeywords] = {
+    tokDef, tokExtern, tokIf,     tokThen,  tokElse,
+    tokFor, tokDo,     tokBinary, tokUnary,
+};
+
+int Lexer::classifyIdentifier(std::string_view ident) {
+    identifier_ = ident;
+    identifierSym_ = Interner::global().intern(ident);
+    if (identifierSym_ < Interner::kNumKeywords)
+        return keywordTokens[identifierSym_];
+    return tokIdentifier;
+}
+
+static_assert(SourceBuffer::kPadding >= charscan::kBlock,
+              "the scanners may read a whole block past the end of the source");
+
+Lexer::Lexer(std::unique_ptr<SourceBuffer> source)
+    : source_(std::move(source)) {
+    cur_ = source_->begin();
+}
 
 // gettok: returns the token from string input
 int Lexer::getTok() {
+    return source_ ? lexBuffer(source_->end()) : lexStream();
+}
+
+int Lexer::lexStream() {
 
     while (std::isspace(lastChar_)) {
         lastChar_ = getchar();
@@ -46,10 +64,7 @@ int Lexer::getTok() {
             identifierStr_.push_back(lastChar_);
         }
 
-        auto resPos = tokenTable_.find(identifierStr_);
-        if (resPos != tokenTable_.end()) return resPos->second;
-        
-        return tokIdentifier;
+        return classifyIdentifier(identifierStr_);
     }
 
     // number: [0-9.]*
@@ -71,7 +86,7 @@ int Lexer::getTok() {
         } while (lastChar_ != EOF && lastChar_ != '\n' && lastChar_ != '\r');
         if (lastChar_ != EOF) {
             // process next line
-            return getTok();
+            return lexStream();
         }
     }
 
@@ -84,12 +99,79 @@ int Lexer::getTok() {
     return thisChar;
 }
 
+// Same grammar as lexStream(), but walks the source buffer with a pointer.
+//  Identifiers are views into the buffer and numbers are parsed in place, so
+//  this path does not touch the heap. Long runs of whitespace, comments,
+//  identifier and number characters are scanned a SIMD block at a time (see
+//  char_scan.h).
+int Lexer::lexBuffer(const char *end) {
+    const char *p = cur_;
+
+    while (true) {
+        p = charscan::skipSpace(p);
+        // annotation
+        if (*p != '#') break;
+        do {
+            p = charscan::findLineEnd(p + 1);
+        } while (*p == '\0' && p != end);
+    }
+    tokStart_ = p;
+
+    // identifier: [a-zA-Z][a-zA-Z0-9]*
+    if (charscan::is(*p, charscan::ccAlpha)) {
+        const char *start = p;
+        p = charscan::skipAlnum(p + 1);
+        cur_ = p;
+        return classifyIdentifier(std::string_view(start, p - start));
+    }
+
+    // number: [0-9.]*
+    if (charscan::is(*p, charscan::ccDigit | charscan::ccDot)) {
+        const char *start = p;
+        p = charscan::skipNumber(p + 1);
+        cur_ = p;
+        numVal_ = charscan::parseNumber(start, p);
+        return tokNumber;
+    }
+
+    if (p == end) {
+        cur_ = p;
+        return tokEof;
+    }
+
+    cur_ = p + 1;
+    return (unsigned char)*p;
+}
+
+std::unique_ptr<TokenStream> Lexer::tokenize() {
+    assert(source_ && "tokenize() needs a lexer in buffer mode");
+    const char *base = source_->begin();
+    auto tokens = std::make_unique<TokenStream>(std::move(source_));
+    // code.test-like sources average a token every 5 bytes
+    tokens->reserve(tokens->source().size() / 5 + 1);
+
+    int tok;
+    do {
+        tok = lexBuffer(tokens->source().end());
+        uint32_t payload = 0;
+        if (tok == tokNumber) payload = tokens->addNumber(numVal_);
+        if (tok == tokIdentifier) payload = identifierSym_;
+        tokens->append(tok, (uint32_t)(tokStart_ - base),
+                       (uint32_t)(cur_ - tokStart_), payload);
+    } while (tok != tokEof);
+    return tokens;
+}
+
 double Lexer::getNumVal() const {
     return numVal_;
 }
 
-const std::string &Lexer::getIdentifierStr() const {
-    return identifierStr_;
+std::string_view Lexer::getIdentifier() const {
+    return identifier_;
+}
+
+SymbolId Lexer::getIdentifierSym() const {
+    return identifierSym_;
 }
 // int main() {
 //     // testing
@@ -14,19 +14,44 @@
    /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
  */
 #pragma once
+#include "interner.h"
+#include "source_buffer.h"
 #include "token.h"
+#include "token_stream.h"
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 class Lexer {
 public:
+    // stream mode: reads stdin char by char, suitable for the REPL
+    Lexer() = default;
+    // buffer mode: tokens are slices of the given source, nothing is copied
+    explicit Lexer(std::unique_ptr<SourceBuffer> source);
+
     // gettok: returns the token from string input
     int getTok();
     double getNumVal() const __attribute__((always_inline));
-    const std::string &getIdentifierStr() const __attribute__((always_inline));
+    // only valid until the next call of getTok()
+    std::string_view getIdentifier() const __attribute__((always_inline));
+    SymbolId getIdentifierSym() const __attribute__((always_inline));
+
+    // buffer mode only: lexes everything that is left into a token buffer,
+    //  which takes over the source. The lexer is spent afterwards.
+    std::unique_ptr<TokenStream> tokenize();
 
 private:
+    int lexStream();
+    int lexBuffer(const char *end);
+    // interns an identifier and tells keywords apart
+    int classifyIdentifier(std::string_view ident);
+
     int lastChar_ = ' ';
     double numVal_ = .0;
     std::string identifierStr_ = "";
-    static std::unordered_map<std::string, Token> tokenTable_;
+    std::string_view identifier_;
+    SymbolId identifierSym_ = kNoSymbol;
+
+    std::unique_ptr<SourceBuffer> source_;
+    const char *cur_ = nullptr;
+    const char *tokStart_ = nullptr;
 };
@@ -0,0 +1,125 @@
+/*
+ * File: source_buffer.cpp
+ * Path: /lexer/source_buffer.cpp
+ * Module: lexer
+ * Lang: C/C++
+ * Created Date: Friday, October 16th 2026, 10:12:05 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file loads a whole source file for the buffer mode of the lexer.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#include "source_buffer.h"
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *const kTooLarge =
+    "larger than 4 GiB, the most the lexer can address";
+
+// what fromFile() returns on failure, saying why
+static std::unique_ptr<SourceBuffer> fail(std::string *error,
+                                          const char *why) {
+    if (error) *error = why;
+    return nullptr;
+}
+
+// A pipe, FIFO or terminal (/dev/stdin, <(generator)) cannot be mapped:
+//  read it to its end into a buffer of our own instead. Closes fd.
+static std::unique_ptr<SourceBuffer> readAll(int fd, std::string *error) {
+    std::string text;
+    char chunk[1 << 16];
+    while (true) {
+        ssize_t n = read(fd, chunk, sizeof chunk);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            close(fd);
+            return fail(error, std::strerror(err));
+        }
+        if (text.size() + (size_t)n > SourceBuffer::kMaxSize) {
+            close(fd);
+            return fail(error, kTooLarge);
+        }
+        text.append(chunk, (size_t)n);
+    }
+    close(fd);
+    return SourceBuffer::fromString(text);
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::fromFile(const char *path,
+                                                     std::string *error) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return fail(error, std::strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        return fail(error, std::strerror(err));
+    }
+    if (!S_ISREG(st.st_mode)) return readAll(fd, error);
+    if ((uint64_t)st.st_size > kMaxSize) {
+        close(fd);
+        return fail(error, kTooLarge);
+    }
+
+    std::unique_ptr<SourceBuffer> buf(new SourceBuffer());
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        buf->owned_ = std::make_unique<char[]>(kPadding);
+        buf->data_ = buf->owned_.get();
+        return buf;
+    }
+
+    // Reserve enough pages for the file plus the padding, then map the file
+    //  over the front of them. Bytes past the end of the file are zero, both
+    //  in the tail of its last page and in the anonymous pages behind it.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapLen = (size + kPadding + page - 1) / page * page;
+    void *base = mmap(nullptr, mapLen, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        return fail(error, std::strerror(err));
+    }
+    void *file = mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (file == MAP_FAILED) {
+        munmap(base, mapLen);
+        return fail(error, std::strerror(err));
+    }
+    // the lexer walks the file front to back exactly once
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    buf->data_ = static_cast<const char *>(base);
+    buf->size_ = size;
+    buf->mappedSize_ = mapLen;
+    return buf;
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::fromString(std::string_view text) {
+    std::unique_ptr<SourceBuffer> buf(new SourceBuffer());
+    // make_unique value-initializes, so the padding is already zero
+    buf->owned_ = std::make_unique<char[]>(text.size() + kPadding);
+    std::memcpy(buf->owned_.get(), text.data(), text.size());
+    buf->data_ = buf->owned_.get();
+    buf->size_ = text.size();
+    return buf;
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (mappedSize_ != 0) munmap(const_cast<char *>(data_), mappedSize_);
+}
@@ -0,0 +1,56 @@
+/*
+ * File: source_buffer.h
+ * Path: /lexer/source_buffer.h
+ * Module: lexer
+ * Lang: C/C++
+ * Created Date: Friday, October 16th 2026, 10:12:05 am
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file is the header of source_buffer.cpp.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// A read-only view of a whole source file, either mmapped or copied from an
+//  in-memory string. kPadding zero bytes after end() are always readable, so
+//  the lexer can look ahead (or load a whole SIMD block) without bounds checks.
+class SourceBuffer {
+public:
+    static constexpr size_t kPadding = 32;
+    // TokenStream keeps 32-bit offsets and lengths into the source
+    static constexpr size_t kMaxSize = UINT32_MAX;
+
+    // returns nullptr if the file cannot be opened, mapped or read, or is
+    //  larger than kMaxSize, and then says why in error if given; what is
+    //  not a regular file (a pipe, /dev/stdin) is read into memory
+    static std::unique_ptr<SourceBuffer> fromFile(const char *path,
+                                                  std::string *error = nullptr);
+    static std::unique_ptr<SourceBuffer> fromString(std::string_view text);
+
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+    ~SourceBuffer();
+
+    const char *begin() const { return data_; }
+    const char *end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    std::string_view view() const { return {data_, size_}; }
+
+private:
+    SourceBuffer() = default;
+
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    // non-zero when data_ points to an mmapped region of this length
+    size_t mappedSize_ = 0;
+    std::unique_ptr<char[]> owned_;
+};
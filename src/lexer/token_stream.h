@@ -0,0 +1,112 @@
+/*
+ * File: token_stream.h
+ * Path: /lexer/token_stream.h
+ * Module: lexer
+ * Lang: C/C++
+ * Created Date: Friday, October 16th 2026, 6:31:18 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file defines the pre-lexed token buffer produced by
+    Lexer::tokenize().
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "interner.h"
+#include "source_buffer.h"
+#include "token.h"
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// All tokens of a source buffer, stored as parallel arrays (structure of
+//  arrays) so that the parser's hot loop over kinds touches 2 bytes per token.
+//  Token i is kind(i) at [offset(i), offset(i) + length(i)) of the source;
+//  the payload of an identifier is its SymbolId, numbers keep their value in
+//  a side table reached through the payload.
+//  The last token is always tokEof, and indices past the end read as tokEof,
+//  so a parser can peek any distance ahead without checks.
+class TokenStream {
+public:
+    explicit TokenStream(std::unique_ptr<SourceBuffer> source)
+        : source_(std::move(source)) {}
+
+    size_t size() const { return kinds_.size(); }
+
+    int kind(size_t i) const {
+        return i < kinds_.size() ? (int)kinds_[i] : (int)tokEof;
+    }
+    uint32_t offset(size_t i) const { return offsets_[i]; }
+    uint32_t length(size_t i) const { return lengths_[i]; }
+
+    std::string_view text(size_t i) const {
+        return {source_->begin() + offsets_[i], lengths_[i]};
+    }
+
+    SymbolId symbol(size_t i) const {
+        assert(kinds_[i] == tokIdentifier);
+        return payloads_[i];
+    }
+
+    double numVal(size_t i) const {
+        assert(kinds_[i] == tokNumber);
+        return numbers_[payloads_[i]];
+    }
+
+    const SourceBuffer &source() const { return *source_; }
+
+    // Token indices where a new top-level item can start: the first token,
+    //  every 'def'/'extern' (they can't appear inside an expression) and the
+    //  token after each ';'. Items between two boundaries can be parsed
+    //  without looking at their neighbours, apart from the operator
+    //  precedences that earlier 'def binary' items install.
+    std::vector<size_t> topLevelBoundaries() const {
+        std::vector<size_t> res;
+        bool atStart = true;
+        for (size_t i = 0, e = size(); i != e; ++i) {
+            int k = kinds_[i];
+            if (k == ';' || k == tokEof) {
+                atStart = true;
+                continue;
+            }
+            if (atStart || k == tokDef || k == tokExtern) res.push_back(i);
+            atStart = false;
+        }
+        return res;
+    }
+
+    // building------------------------------------------------------------
+    void reserve(size_t n) {
+        kinds_.reserve(n);
+        offsets_.reserve(n);
+        lengths_.reserve(n);
+        payloads_.reserve(n);
+    }
+
+    void append(int kind, uint32_t offset, uint32_t length,
+                uint32_t payload = 0) {
+        kinds_.push_back((int16_t)kind);
+        offsets_.push_back(offset);
+        lengths_.push_back(length);
+        payloads_.push_back(payload);
+    }
+
+    uint32_t addNumber(double v) {
+        numbers_.push_back(v);
+        return (uint32_t)(numbers_.size() - 1);
+    }
+
+private:
+    std::unique_ptr<SourceBuffer> source_;
+    // char tokens are 0..255 and the named ones are negative
+    std::vector<int16_t> kinds_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> lengths_;
+    std::vector<uint32_t> payloads_;
+    std::vector<double> numbers_;
+};
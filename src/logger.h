@@ -16,15 +16,41 @@
 #include "compiler_type.h"
 #include <iostream>
 #include <llvm-18/llvm/IR/Value.h>
+#include <llvm-18/llvm/Support/raw_ostream.h>
 #include <memory>
 
 template <CompilerType CT> class ExprAST;
 template <CompilerType CT> class PrototypeAST;
 
+// set on a thread while it parses source that will be parsed again later,
+//  so that each error is reported once
+inline thread_local bool muteErrors = false;
+
+// where the errors of a thread go instead of std::cout, when its output is
+//  collected to be printed in order later
+inline thread_local llvm::raw_ostream *errorSink = nullptr;
+
+// sends the errors of this thread to os while in scope
+class ScopedErrorSink {
+public:
+    explicit ScopedErrorSink(llvm::raw_ostream &os) : prev_(errorSink) {
+        errorSink = &os;
+    }
+    ~ScopedErrorSink() { errorSink = prev_; }
+    ScopedErrorSink(const ScopedErrorSink &) = delete;
+    ScopedErrorSink &operator=(const ScopedErrorSink &) = delete;
+
+private:
+    llvm::raw_ostream *prev_;
+};
+
 template <CompilerType CT>
-std::unique_ptr<ExprAST<CT>> __attribute__((always_inline))
-LogErr(const char *str) {
-    std::cout << stderr << "Error: " << str << std::endl;
+    ExprAST<CT> __attribute__((always_inline)) * LogErr(const char *str) {
+    if (muteErrors) return nullptr;
+    if (errorSink)
+        *errorSink << "Error: " << str << "\n";
+    else
+        std::cout << stderr << "Error: " << str << std::endl;
     return nullptr;
 }
 
@@ -12,36 +12,120 @@
     _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
    /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
  */
+#include "aot_backend.h"
 #include "compiler_type.h"
 #include "driver.h"
+#include "incremental_build.h"
+#include "multi_file_build.h"
+#include "options.h"
 #include "parser.h"
+#include "source_buffer.h"
 #include "utils.h"
+#include <llvm-18/llvm/Support/Error.h>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 int main(int argc, char *argv[]) {
-    bool enableInteractive = true;
-    bool enableOptimization = true;
+    CompilerOptions opts;
+    if (!parseOptions(argc, argv, opts)) return -1;
 
-    if (argc > 2) {
-        printf("error: input more than one file");
-        return -1;
-    }
-    if (argc == 2) {
-        auto filename = argv[1];
-        if (freopen(filename, "r", stdin) == nullptr) {
-            std::cerr << "Error: Failed to open file." << std::endl;
+    std::unique_ptr<SourceBuffer> source;
+    // with many input files the driver runs the prelude, if any
+    const char *first = opts.multiFile() ? opts.prelude : opts.inputFile;
+    if (first) {
+        // map the whole file and lex it in place instead of going via stdin
+        std::string error;
+        source = SourceBuffer::fromFile(first, &error);
+        if (source == nullptr) {
+            std::cerr << "Error: Failed to open file: " << error << "."
+                      << std::endl;
             return 1;
         }
-        enableInteractive = false;
+    } else if (opts.multiFile()) {
+        source = SourceBuffer::fromString("");
+    }
+    // all of them before compiling any
+    std::vector<std::unique_ptr<SourceBuffer>> files;
+    if (opts.multiFile()) {
+        for (const char *file : opts.inputFiles) {
+            std::string error;
+            files.push_back(SourceBuffer::fromFile(file, &error));
+            if (files.back() == nullptr) {
+                std::cerr << "Error: Failed to open file " << file << ": "
+                          << error << "." << std::endl;
+                return 1;
+            }
+        }
     }
 
-    Driver<CompilerType::AOT> driver(enableOptimization, enableInteractive);
+    Driver<CompilerType::AOT> driver(opts, std::move(source));
     ParserEnv<CompilerType::AOT> *pEnv = driver.getParserEnv();
 
+    // -emit: the module is for the target from the start
+    llvm::ExitOnError exitOnErr("aot_compiler: ");
+    std::unique_ptr<AotBackend> backend;
+    if (opts.emit != EmitKind::None) {
+        backend = exitOnErr(AotBackend::create(
+            opts.targetTriple ? opts.targetTriple : "",
+            opts.targetCPU ? opts.targetCPU : "",
+            opts.targetAttrs ? opts.targetAttrs : "", opts.optLevel));
+        if (opts.wholeProgram)
+            backend->setWholeProgram(opts.codegenThreads, opts.printStats);
+        if (opts.multiversion) exitOnErr(backend->setMultiversion());
+        backend->prepare(*pEnv->getModule());
+        // the per-module pipeline tunes for the target too
+        pEnv->setTargetMachineFactory(
+            [b = backend.get()] { return b->createTargetMachine(); });
+    }
+    std::unique_ptr<IncrementalBuild> incremental;
+    if (opts.buildDir) {
+        incremental = std::make_unique<IncrementalBuild>(
+            opts.buildDir, opts, *backend, driver.getParser()->getTokens(),
+            pEnv);
+        if (!incremental->getError().empty()) {
+            fprintf(stderr, "error: no build directory %s: %s\n",
+                    opts.buildDir, incremental->getError().c_str());
+            return 1;
+        }
+        driver.setIncrementalBuild(incremental.get());
+    }
+    std::unique_ptr<MultiFileBuild> multiFile;
+    if (opts.multiFile()) {
+        multiFile = std::make_unique<MultiFileBuild>(
+            opts, backend.get(), pEnv, opts.prelude ? opts.prelude : "");
+        for (size_t i = 0; i != files.size(); ++i)
+            multiFile->addFile(opts.inputFiles[i], std::move(files[i]));
+    }
+
     // Run the main "interpreter loop" now.
     driver.mainLoop();
+    if (multiFile) exitOnErr(multiFile->run());
 
-    pEnv->printErr();
+    if (backend) {
+        std::string output =
+            opts.outputFile ? opts.outputFile
+                            : AotBackend::defaultOutput(opts.emit,
+                                                        opts.inputFile);
+        if (incremental)
+            exitOnErr(incremental->link(opts.emit, output));
+        else if (multiFile)
+            exitOnErr(multiFile->link(opts.emit, output));
+        else
+            exitOnErr(backend->emit(*pEnv->getModule(), opts.emit, output));
+    } else if (!multiFile) { // else MultiFileBuild::run() printed it
+        pEnv->printErr();
+    }
+    if (opts.printStats) {
+        if (multiFile)
+            driver.addStats(multiFile->getAstStats(),
+                            multiFile->getOptStats());
+        driver.printStats();
+        if (opts.wholeProgram) backend->getStats().print();
+        if (incremental) incremental->getStats().print();
+        if (opts.multiversion) backend->getMultiversionStats().print();
+        if (multiFile) multiFile->printStats();
+    }
 
     return 0;
 }
@@ -14,33 +14,58 @@
  */
 #include "compiler_type.h"
 #include "driver.h"
+#include "options.h"
 #include "parser.h"
+#include "source_buffer.h"
 #include "utils.h"
+#include <string>
+#include <vector>
 
 int main(int argc, char *argv[]) {
-    bool enableInteractive = true;
-    bool enableOptimization = true;
+    CompilerOptions opts;
+    if (!parseOptions(argc, argv, opts)) return -1;
 
-    if (argc > 2) {
-        printf("error: input more than one file");
-        return -1;
-    }
-    if (argc == 2) {
-        auto filename = argv[1];
-        if (freopen(filename, "r", stdin) == nullptr) {
-            std::cerr << "Error: Failed to open file." << std::endl;
+    std::unique_ptr<SourceBuffer> source;
+    // with many input files the driver runs the prelude, if any
+    const char *first = opts.multiFile() ? opts.prelude : opts.inputFile;
+    if (first) {
+        // map the whole file and lex it in place instead of going via stdin
+        std::string error;
+        source = SourceBuffer::fromFile(first, &error);
+        if (source == nullptr) {
+            std::cerr << "Error: Failed to open file: " << error << "."
+                      << std::endl;
             return 1;
         }
-        enableInteractive = false;
+    } else if (opts.multiFile()) {
+        source = SourceBuffer::fromString("");
+    }
+    // all of them before compiling any
+    std::vector<std::unique_ptr<SourceBuffer>> files;
+    if (opts.multiFile()) {
+        for (const char *file : opts.inputFiles) {
+            std::string error;
+            files.push_back(SourceBuffer::fromFile(file, &error));
+            if (files.back() == nullptr) {
+                std::cerr << "Error: Failed to open file " << file << ": "
+                          << error << "." << std::endl;
+                return 1;
+            }
+        }
     }
 
-    Driver<CompilerType::JIT> driver(enableOptimization, enableInteractive);
+    Driver<CompilerType::JIT> driver(opts, std::move(source));
     ParserEnv<CompilerType::JIT> *pEnv = driver.getParserEnv();
 
     // Run the main "interpreter loop" now.
     driver.mainLoop();
+    if (opts.multiFile())
+        driver.compileFiles(std::move(files),
+                            std::vector<std::string>(opts.inputFiles.begin(),
+                                                     opts.inputFiles.end()));
 
     pEnv->printErr();
+    if (opts.printStats) driver.printStats();
 
     return 0;
 }
@@ -0,0 +1,315 @@
+/*
+ * File: options.h
+ * Path: /options.h
+ * Module: src
+ * Lang: C/C++
+ * Created Date: Saturday, October 17th 2026, 3:05:42 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file parses the command line shared by the AOT and JIT compilers.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// what the AOT compiler writes, besides a C header of the definitions
+enum class EmitKind {
+    None,    // only the IR, printed to stderr
+    Object,  // a relocatable object file
+    Archive, // a static library of that object
+    Shared,  // a shared library, linked by the system compiler driver
+};
+
+struct CompilerOptions {
+    // nullptr: read stdin as a REPL, or see multiFile()
+    const char *inputFile = nullptr;
+    bool interactive = true;
+    // All input files. More than one, or any with a prelude, are compiled
+    //  apart on jobs threads, each seeing only what the prelude declares,
+    //  defines and installs (operators), which the driver runs first
+    std::vector<const char *> inputFiles;
+    const char *prelude = nullptr;
+    // -O0 to -O3, the LLVM default pipeline of that level; 0 skips it
+    unsigned optLevel = 2;
+    // emit IR from the flat AST encoding instead of the node tree
+    bool flatCodegen = true;
+    // fold constants and merge identical subexpressions of the flat AST
+    bool astOpt = true;
+    // JIT, file input: parse and compile top-level items on a thread pool
+    bool batch = false;
+    // threads for batch mode and multiFile(), 0 = all cores
+    unsigned jobs = 0;
+    // JIT: compile definitions unoptimized first, then recompile the ones
+    //  called hotCalls times at -O3 in the background
+    bool tiered = false;
+    unsigned hotCalls = 1000;
+    // JIT: optimize and compile each definition on its first call only
+    bool lazy = false;
+    // JIT: optimize and compile on this many threads while the driver
+    //  parses on, 0 = on the driver thread when first needed
+    unsigned compileThreads = 0;
+    // JIT: keep compiled objects in this directory across runs
+    const char *cacheDir = nullptr;
+    // JIT, file input: compile each run of consecutive top-level
+    //  expressions as one module instead of one module per expression
+    bool exprBatch = false;
+    // JIT: run cold code from bytecode, compile loops at once and functions
+    //  once they are called interpHot times (0: never)
+    bool interp = false;
+    unsigned interpHot = 100;
+    // JIT: link with JITLink into slabs of this many MiB reserved up front,
+    //  0 = with RuntimeDyld, mapping fresh pages for every object
+    unsigned jitlinkSlabMB = 0;
+    // JIT: pack code and read-only data together on huge pages (JITLink)
+    bool jitHugePages = false;
+    // AOT: machine code to emit, to outputFile (default: named after the
+    //  input), for targetTriple (default: the host)
+    EmitKind emit = EmitKind::None;
+    const char *outputFile = nullptr;
+    const char *targetTriple = nullptr;
+    // the CPU to generate code for ("native": the host's, with its
+    //  features; default: native for the JIT, generic for -emit), and
+    //  features to turn on or off on top of its own ("+avx2,-fma")
+    const char *targetCPU = nullptr;
+    const char *targetAttrs = nullptr;
+    // AOT, -emit, x86-64: every function in an SSE2, an AVX2 and an
+    //  AVX-512 version, the one for the CPU picked at load time
+    bool multiversion = false;
+    // AOT, -emit: optimize as a whole program, exporting only what the
+    //  header declares, and split codegen over codegenThreads threads
+    //  (0 = all cores)
+    bool wholeProgram = false;
+    unsigned codegenThreads = 0;
+    // AOT, -emit, file input: compile each definition on its own and keep
+    //  the objects in this directory, to rebuild only what changed
+    const char *buildDir = nullptr;
+    // print compiler statistics to stderr at exit
+    bool printStats = false;
+
+    bool multiFile() const { return prelude || inputFiles.size() > 1; }
+};
+
+inline void printUsage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] [file...]\n"
+            "  -O0 .. -O3      optimization level (default: -O2)\n"
+            "  -stats          print compiler statistics at exit\n"
+            "  -tree-codegen   generate IR by walking the AST tree instead of "
+            "its flat encoding\n"
+            "  -no-ast-opt     do not fold or merge subexpressions before "
+            "codegen\n"
+            "  -batch          (JIT) parse and compile the items of the input "
+            "file in parallel\n"
+            "  -j N            threads for -batch and for many input files "
+            "(default: all cores)\n"
+            "  -prelude FILE   externs, defs and operators for each of the "
+            "input files,\n"
+            "                  which are compiled apart, in parallel\n"
+            "  -tiered         (JIT) compile definitions unoptimized, "
+            "recompile hot ones at -O3\n"
+            "  -hot N          calls that make a function hot for -tiered "
+            "(default: 1000)\n"
+            "  -lazy           (JIT) compile each function on its first call "
+            "only\n"
+            "  -compile-threads N\n"
+            "                  (JIT) optimize and compile on N threads while "
+            "parsing goes on\n"
+            "  -cache-dir DIR  (JIT) reuse the objects compiled by earlier "
+            "runs, kept in DIR\n"
+            "  -expr-batch     (JIT) compile each run of consecutive top-level "
+            "expressions at once\n"
+            "  -interp         (JIT) interpret cold code, compile loops and "
+            "hot functions\n"
+            "  -interp-hot N   calls that make a function hot for -interp "
+            "(default: 100,\n"
+            "                  0: never, functions stay in the interpreter)\n"
+            "  -jitlink        (JIT) link with JITLink into memory reserved "
+            "up front\n"
+            "  -jitlink-slab MB\n"
+            "                  size of each region -jitlink or "
+            "-jit-huge-pages reserves\n"
+            "                  (default: 64)\n"
+            "  -jit-huge-pages (JIT) link code and read-only data onto shared "
+            "huge pages\n"
+            "  -emit obj|lib|so\n"
+            "                  (AOT) write an object file, a static or a "
+            "shared library,\n"
+            "                  and a C header of its functions\n"
+            "  -o FILE         (AOT) output of -emit\n"
+            "  -mtriple T      (AOT) target triple for -emit (default: the "
+            "host)\n"
+            "  -mcpu CPU       target CPU, native for the host's (default: "
+            "native for the JIT,\n"
+            "                  generic for -emit)\n"
+            "  -mattr A,...    target features to add (+avx2) or remove "
+            "(-fma)\n"
+            "  -multiversion   (AOT) emit SSE2, AVX2 and AVX-512 versions of "
+            "each function,\n"
+            "                  one picked by the CPU when the output is "
+            "loaded (x86-64 ELF);\n"
+            "                  all built for x86-64 plus their ISA, -mcpu "
+            "and -mattr ignored\n"
+            "  -whole-program  (AOT) optimize -emit output as a whole program "
+            "and run codegen\n"
+            "                  on all cores\n"
+            "  -codegen-threads N\n"
+            "                  threads for -whole-program codegen\n"
+            "  -incremental DIR\n"
+            "                  (AOT) rebuild only the definitions that "
+            "changed since the\n"
+            "                  last -emit, from objects kept in DIR\n",
+            prog);
+}
+
+// returns false (after printing why) if the command line is invalid
+inline bool parseOptions(int argc, char *argv[], CompilerOptions &opts) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3' &&
+            arg[3] == '\0') {
+            opts.optLevel = (unsigned)(arg[2] - '0');
+        } else if (std::strcmp(arg, "-stats") == 0) {
+            opts.printStats = true;
+        } else if (std::strcmp(arg, "-tree-codegen") == 0) {
+            opts.flatCodegen = false;
+        } else if (std::strcmp(arg, "-no-ast-opt") == 0) {
+            opts.astOpt = false;
+        } else if (std::strcmp(arg, "-batch") == 0) {
+            opts.batch = true;
+        } else if (std::strcmp(arg, "-j") == 0 && i + 1 < argc) {
+            opts.jobs = (unsigned)std::atoi(argv[++i]);
+            opts.batch = true;
+        } else if (std::strcmp(arg, "-tiered") == 0) {
+            opts.tiered = true;
+        } else if (std::strcmp(arg, "-hot") == 0 && i + 1 < argc) {
+            opts.hotCalls = (unsigned)std::atoi(argv[++i]);
+            opts.tiered = true;
+            // the counter is checked after it is bumped, from 1 on
+            if (!opts.hotCalls) {
+                fprintf(stderr, "error: -hot must be at least 1\n");
+                return false;
+            }
+        } else if (std::strcmp(arg, "-lazy") == 0) {
+            opts.lazy = true;
+        } else if (std::strcmp(arg, "-compile-threads") == 0 &&
+                   i + 1 < argc) {
+            opts.compileThreads = (unsigned)std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "-cache-dir") == 0 && i + 1 < argc) {
+            opts.cacheDir = argv[++i];
+        } else if (std::strcmp(arg, "-expr-batch") == 0) {
+            opts.exprBatch = true;
+        } else if (std::strcmp(arg, "-interp") == 0) {
+            opts.interp = true;
+        } else if (std::strcmp(arg, "-interp-hot") == 0 && i + 1 < argc) {
+            // 0 is a setting of its own, so it must not be what atoi makes
+            //  of a typo
+            const char *n = argv[++i];
+            char *end;
+            unsigned long calls = std::strtoul(n, &end, 10);
+            if (!std::isdigit((unsigned char)*n) || *end || calls > UINT_MAX) {
+                fprintf(stderr, "error: -interp-hot takes a number of calls, "
+                                "not '%s'\n", n);
+                return false;
+            }
+            opts.interpHot = (unsigned)calls;
+            opts.interp = true;
+        } else if (std::strcmp(arg, "-jitlink") == 0) {
+            if (!opts.jitlinkSlabMB) opts.jitlinkSlabMB = 64;
+        } else if (std::strcmp(arg, "-jit-huge-pages") == 0) {
+            opts.jitHugePages = true;
+            if (!opts.jitlinkSlabMB) opts.jitlinkSlabMB = 64;
+        } else if (std::strcmp(arg, "-jitlink-slab") == 0 && i + 1 < argc) {
+            opts.jitlinkSlabMB = (unsigned)std::atoi(argv[++i]);
+            if (!opts.jitlinkSlabMB) {
+                fprintf(stderr, "error: -jitlink-slab must be at least 1\n");
+                return false;
+            }
+        } else if (std::strcmp(arg, "-emit") == 0 && i + 1 < argc) {
+            const char *kind = argv[++i];
+            if (std::strcmp(kind, "obj") == 0) {
+                opts.emit = EmitKind::Object;
+            } else if (std::strcmp(kind, "lib") == 0) {
+                opts.emit = EmitKind::Archive;
+            } else if (std::strcmp(kind, "so") == 0) {
+                opts.emit = EmitKind::Shared;
+            } else {
+                fprintf(stderr, "error: -emit takes obj, lib or so\n");
+                return false;
+            }
+        } else if (std::strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            opts.outputFile = argv[++i];
+        } else if (std::strcmp(arg, "-mtriple") == 0 && i + 1 < argc) {
+            opts.targetTriple = argv[++i];
+        } else if (std::strcmp(arg, "-mcpu") == 0 && i + 1 < argc) {
+            opts.targetCPU = argv[++i];
+        } else if (std::strcmp(arg, "-mattr") == 0 && i + 1 < argc) {
+            opts.targetAttrs = argv[++i];
+        } else if (std::strcmp(arg, "-multiversion") == 0) {
+            opts.multiversion = true;
+        } else if (std::strcmp(arg, "-whole-program") == 0) {
+            opts.wholeProgram = true;
+        } else if (std::strcmp(arg, "-codegen-threads") == 0 &&
+                   i + 1 < argc) {
+            opts.codegenThreads = (unsigned)std::atoi(argv[++i]);
+            opts.wholeProgram = true;
+        } else if (std::strcmp(arg, "-incremental") == 0 && i + 1 < argc) {
+            opts.buildDir = argv[++i];
+        } else if (std::strcmp(arg, "-prelude") == 0 && i + 1 < argc) {
+            opts.prelude = argv[++i];
+        } else if (std::strcmp(arg, "-h") == 0 ||
+                   std::strcmp(arg, "-help") == 0) {
+            printUsage(argv[0]);
+            return false;
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "error: unknown option %s\n", arg);
+            printUsage(argv[0]);
+            return false;
+        } else {
+            opts.inputFiles.push_back(arg);
+        }
+    }
+    if (opts.multiFile() || !opts.inputFiles.empty()) opts.interactive = false;
+    if (!opts.multiFile() && !opts.inputFiles.empty())
+        opts.inputFile = opts.inputFiles[0];
+    if (opts.lazy && opts.tiered) {
+        fprintf(stderr, "error: -lazy and -tiered do not go together\n");
+        return false;
+    }
+    // the interpreter compiles from the flat encoding, one item at a time
+    if (opts.interp && (opts.tiered || opts.lazy || opts.batch ||
+                        opts.exprBatch || !opts.flatCodegen)) {
+        fprintf(stderr, "error: -interp does not go with -tiered, -lazy, "
+                        "-batch, -expr-batch or -tree-codegen\n");
+        return false;
+    }
+    if (opts.multiFile() && (opts.interp || opts.wholeProgram)) {
+        fprintf(stderr, "error: -interp and -whole-program take one input "
+                        "file and no -prelude\n");
+        return false;
+    }
+    if (opts.wholeProgram && opts.emit == EmitKind::None) {
+        fprintf(stderr, "error: -whole-program needs -emit\n");
+        return false;
+    }
+    if (opts.multiversion && opts.emit == EmitKind::None) {
+        fprintf(stderr, "error: -multiversion needs -emit\n");
+        return false;
+    }
+    // definitions are compiled apart, from the tokens of a file
+    if (opts.buildDir && (opts.emit == EmitKind::None || opts.wholeProgram ||
+                          !opts.inputFile)) {
+        fprintf(stderr, "error: -incremental needs -emit and one input file, "
+                        "and does not go with -whole-program or -prelude\n");
+        return false;
+    }
+    return true;
+}
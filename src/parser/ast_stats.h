@@ -0,0 +1,80 @@
+/*
+ * File: ast_stats.h
+ * Path: /parser/ast_stats.h
+ * Module: parser
+ * Lang: C/C++
+ * Created Date: Saturday, October 17th 2026, 6:20:51 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file counts what the parser allocates for -stats.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "ast.h"
+#include "compiler_type.h"
+#include <cstddef>
+#include <cstdio>
+
+// Allocation counts of the expression trees, summed over all definitions
+struct AstStats {
+    size_t functions = 0;
+    size_t nodes = 0;
+    size_t argLists = 0;
+    size_t bytes = 0;
+    size_t slabs = 0;
+    size_t flatNodes = 0;
+    size_t flatBytes = 0;
+    FlatOptStats opt;
+
+    // called once per parsed definition, after FunctionAST::lower() (which
+    //  counts its -ast-opt work into opt); only counts
+    template <CompilerType CT> void record(const FunctionAST<CT> &fn) {
+        flatNodes += fn.getFlat().size();
+        flatBytes += fn.getFlat().bytes();
+        const AstArena &arena = fn.getArena();
+        ++functions;
+        nodes += arena.nodes();
+        argLists += arena.arrays();
+        bytes += arena.bytes();
+        slabs += arena.slabs();
+    }
+
+    AstStats &operator+=(const AstStats &o) {
+        functions += o.functions;
+        nodes += o.nodes;
+        argLists += o.argLists;
+        bytes += o.bytes;
+        slabs += o.slabs;
+        flatNodes += o.flatNodes;
+        flatBytes += o.flatBytes;
+        opt += o.opt;
+        return *this;
+    }
+
+    // Each tree used to be one heap block per node plus one per argument
+    //  vector, each freed on its own; now it is a few arena slabs per
+    //  definition, freed together. The old count is not measured (that
+    //  path is gone) but worked out from the nodes and lists, so it is
+    //  printed as an estimate.
+    void print() const {
+        fprintf(stderr,
+                "ast: %zu functions, %zu nodes + %zu arg lists (%zu bytes)\n"
+                "ast: %zu arena slabs allocated and freed, instead of an "
+                "estimated %zu heap allocations and frees (one per node and "
+                "arg list)\n",
+                functions, nodes, argLists, bytes, slabs, nodes + argLists);
+        if (flatNodes)
+            fprintf(stderr, "ast: %zu flat nodes (%zu bytes) for codegen\n",
+                    flatNodes, flatBytes);
+        if (opt.nodesIn)
+            fprintf(stderr,
+                    "ast-opt: %zu -> %zu nodes, %zu folded, %zu simplified, "
+                    "%zu shared\n",
+                    opt.nodesIn, opt.nodesOut, opt.folded, opt.simplified,
+                    opt.shared);
+    }
+};
@@ -0,0 +1,435 @@
+/*
+ * File: batch_driver.h
+ * Path: /parser/batch_driver.h
+ * Module: parser
+ * Lang: C/C++
+ * Created Date: Saturday, October 17th 2026, 6:02:37 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file parses and generates IR for the top-level items of a source
+    file on a thread pool, then feeds the JIT in source order.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "ast_stats.h"
+#include "compiler_type.h"
+#include "file_stats.h"
+#include "lexer.h"
+#include "logger.h"
+#include "parser.h"
+#include "source_buffer.h"
+#include "token_stream.h"
+#include <llvm-18/llvm/ADT/StringSet.h>
+#include <llvm-18/llvm/Support/Error.h>
+#include <llvm-18/llvm/Support/ThreadPool.h>
+#include <llvm-18/llvm/Support/Threading.h>
+#include <llvm-18/llvm/Support/raw_ostream.h>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Receives each finished module in source order; a run of consecutive
+//  top-level expressions arrives as one module with -expr-batch.
+//  expressions runs its entry points and prints what they evaluate to.
+struct ModuleSink {
+    std::function<llvm::Error(llvm::orc::ThreadSafeModule)> definition;
+    std::function<llvm::Error(llvm::orc::ThreadSafeModule, unsigned)>
+        expressions;
+};
+
+// The entry point of the i-th top-level expression of a module. Each one
+//  is generated as __anon_expr, then renamed, so that a run of them can
+//  share a module (-expr-batch).
+inline std::string exprEntryName(unsigned i) {
+    return "__anon_expr." + std::to_string(i);
+}
+
+// whether a run of top-level expressions goes on at tok: it ends at the
+//  next def or extern, or the end, and ';' separates its items
+inline bool continuesExpressions(int tok) {
+    return tok != tokEof && tok != tokDef && tok != tokExtern;
+}
+
+// Batch mode. The source is cut at TokenStream::topLevelBoundaries() into
+//  chunks, and runs of consecutive chunks become tasks. Each task is parsed
+//  and compiled on a pool thread by a worker env of its own, into its own
+//  LLVMContext/Module per unit, exactly like Driver would do it serially.
+//  The main thread then prints the logs, errors included, and hands the
+//  modules to the JIT in source order, running top-level expressions as it
+//  meets them. With -expr-batch, a worker puts a run of expressions into
+//  one module, as the serial driver does; a run never spans two tasks.
+//
+//  The only state a chunk takes from the earlier source is the set of
+//  operator precedences and prototypes. Both are collected up front by a
+//  sequential pass that parses just the prototype at the head of every
+//  def/extern chunk, which is cheap next to parsing and compiling bodies.
+//  As a difference from the serial loop, a 'def binary' installs its
+//  precedence even if its body later fails to compile. Its prototype is
+//  seen by the later chunks as well, so a module that calls a def that did
+//  not compile is dropped with an error when its turn to go to the JIT
+//  comes, and so are the modules that call the functions it defines.
+//
+//  Given many input files instead, each file is a task, lexed on its worker
+//  too, which sees the prototypes and precedences mainEnv has from the
+//  prelude the driver ran first, and nothing of the files before it: they
+//  are compiled apart, and call each other through externs. The modules
+//  still go to the JIT in command line order.
+//  Only the JIT driver uses it: AOT output is a single module, and for many
+//  files an object each (see MultiFileBuild).
+template <CompilerType CT> class BatchDriver {
+public:
+    BatchDriver(std::shared_ptr<const TokenStream> tokens,
+                ParserEnv<CT> *mainEnv, ModuleSink sink, unsigned jobs,
+                bool flatCodegen, bool astOpt, bool exprBatch)
+        : tokens_(std::move(tokens)), mainEnv_(mainEnv),
+          sink_(std::move(sink)), jobs_(jobs),
+          flatCodegen_(flatCodegen), astOpt_(astOpt), exprBatch_(exprBatch),
+          dataLayout_(
+              mainEnv->getJIT()->getDataLayout().getStringRepresentation()) {}
+
+    // the files, with the names to report them by
+    BatchDriver(std::vector<std::unique_ptr<SourceBuffer>> files,
+                const std::vector<std::string> &names,
+                ParserEnv<CT> *mainEnv, ModuleSink sink, unsigned jobs,
+                bool flatCodegen, bool astOpt, bool exprBatch)
+        : BatchDriver(nullptr, mainEnv, std::move(sink), jobs, flatCodegen,
+                      astOpt, exprBatch) {
+        for (size_t i = 0; i != files.size(); ++i) {
+            Task task;
+            task.source = std::move(files[i]);
+            task.precedence = mainEnv->getBinoPrecedences();
+            task.file.name = names[i];
+            tasks_.push_back(std::move(task));
+        }
+    }
+
+    void run() {
+        auto t0 = std::chrono::steady_clock::now();
+        if (tokens_) {
+            std::vector<size_t> chunks = tokens_->topLevelBoundaries();
+            if (chunks.empty()) return;
+            numChunks_ = chunks.size();
+            makeTasks(chunks);
+            scanPrototypes(chunks);
+        }
+
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs_));
+        threads_ = pool.getThreadCount();
+        std::vector<std::shared_future<void>> done;
+        done.reserve(tasks_.size());
+        for (Task &task : tasks_)
+            done.push_back(pool.async([this, &task] { runTask(task); }));
+
+        // replay in source order while later tasks are still compiling
+        for (size_t i = 0; i != tasks_.size(); ++i) {
+            done[i].wait();
+            for (Unit &unit : tasks_[i].units) replay(unit);
+            astStats_ += tasks_[i].stats;
+            optStats_ += tasks_[i].optStats;
+            tasks_[i].units.clear();
+        }
+        pool.wait();
+        std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        wallSeconds_ = dt.count();
+    }
+
+    const AstStats &getAstStats() const { return astStats_; }
+
+    // summed over the workers, each of which has a pipeline of its own
+    const OptStats &getOptStats() const { return optStats_; }
+
+    void printStats() const {
+        if (!tokens_) {
+            std::vector<FileStats> files;
+            for (const Task &task : tasks_) files.push_back(task.file);
+            printFileStats(files, threads_, wallSeconds_);
+            return;
+        }
+        fprintf(stderr, "batch: %zu chunks in %zu tasks on %u threads\n",
+                numChunks_, tasks_.size(), threads_);
+    }
+
+private:
+    // what one task produced for one top-level item (or a run of them)
+    struct Unit {
+        enum Kind { LogOnly, Definitions, Expressions } kind;
+        llvm::orc::ThreadSafeModule module;
+        std::string log;
+        unsigned exprs; // entry points of Expressions
+        // defs that did not compile since the unit before
+        std::vector<std::string> failed;
+    };
+
+    struct Task {
+        // the token range; of a file, all of it once lexed
+        std::shared_ptr<const TokenStream> tokens;
+        size_t begin = 0, end = 0;
+        size_t firstChunk = 0;
+        // a file, until its worker lexes it
+        std::unique_ptr<SourceBuffer> source;
+        std::map<char, int> precedence; // in effect at begin
+        std::vector<Unit> units;
+        AstStats stats;
+        OptStats optStats;
+        FileStats file;
+    };
+
+    // Prototypes by symbol, each with the chunk that declares it, in source
+    //  order. Only read once the workers run.
+    const PrototypeAST<CT> *lookupProto(SymbolId sym, size_t beforeChunk) {
+        auto found = protos_.find(sym);
+        if (found == protos_.end()) return nullptr;
+        const auto &decls = found->second;
+        for (auto it = decls.rbegin(); it != decls.rend(); ++it)
+            if (it->first < beforeChunk) return it->second.get();
+        return nullptr;
+    }
+
+    std::unique_ptr<ParserEnv<CT>>
+    makeWorkerEnv(unsigned optLevel, const std::map<char, int> &precedence,
+                  OuterProtoLookup<CT> outerProtos) {
+        auto env = std::make_unique<ParserEnv<CT>>(optLevel);
+        env->initializeWorker(dataLayout_, precedence, std::move(outerProtos),
+                              mainEnv_->getTargetMachineFactory());
+        return env;
+    }
+
+    // a few tasks per thread, of about the same number of tokens
+    void makeTasks(const std::vector<size_t> &chunks) {
+        unsigned threads =
+            jobs_ ? jobs_ : llvm::hardware_concurrency().compute_thread_count();
+        size_t target = tokens_->size() / (threads * 4) + 1;
+        size_t first = 0;
+        for (size_t i = 1; i <= chunks.size(); ++i) {
+            size_t end = i == chunks.size() ? tokens_->size() : chunks[i];
+            if (i != chunks.size() && end - chunks[first] < target) continue;
+            Task task;
+            task.tokens = tokens_;
+            task.begin = chunks[first];
+            task.end = end;
+            task.firstChunk = first;
+            tasks_.push_back(std::move(task));
+            first = i;
+        }
+    }
+
+    // fills protos_ and the precedences each task starts with
+    void scanPrototypes(const std::vector<size_t> &chunks) {
+        std::map<char, int> precedence = mainEnv_->getBinoPrecedences();
+        // only parses, so no optimizer
+        Parser<CT> scan(tokens_, 0, tokens_->size(),
+                        makeWorkerEnv(0, precedence, nullptr));
+        // the workers parse these prototypes again and report their errors
+        muteErrors = true;
+        size_t nextTask = 0;
+        for (size_t i = 0; i != chunks.size(); ++i) {
+            if (nextTask != tasks_.size() && tasks_[nextTask].firstChunk == i)
+                tasks_[nextTask++].precedence = precedence;
+            int head = tokens_->kind(chunks[i]);
+            if (head != tokDef && head != tokExtern) continue;
+            scan.rewind(chunks[i] + 1);
+            auto proto = scan.parsePrototype();
+            if (!proto) continue;
+            if (head == tokDef && proto->isBinaryOp())
+                precedence[proto->getOpName()] =
+                    static_cast<BinaryOperatorAST<CT> &>(*proto)
+                        .getBinaryPrecedence();
+            if (head == tokDef) defNames_[chunks[i]] = proto->getName();
+            protos_[proto->getSymbol()].emplace_back(i, std::move(proto));
+        }
+        muteErrors = false;
+    }
+
+    void runTask(Task &task) {
+        auto t0 = std::chrono::steady_clock::now();
+        OuterProtoLookup<CT> outerProtos;
+        if (task.source) {
+            task.tokens = Lexer(std::move(task.source)).tokenize();
+            task.end = task.file.tokens = task.tokens->size();
+            // mainEnv_ is left alone while the workers run
+            outerProtos = [this](SymbolId sym) {
+                return mainEnv_->getProto(sym);
+            };
+        } else {
+            size_t firstChunk = task.firstChunk;
+            outerProtos = [this, firstChunk](SymbolId sym) {
+                return lookupProto(sym, firstChunk);
+            };
+        }
+        Parser<CT> parser(task.tokens, task.begin, task.end,
+                          makeWorkerEnv(mainEnv_->getOptLevel(),
+                                        task.precedence,
+                                        std::move(outerProtos)));
+        ParserEnv<CT> *env = parser.getEnv();
+        std::string log;
+        llvm::raw_string_ostream os(log);
+        ScopedErrorSink errors(os);
+        unsigned exprs = 0; // in the module, not emitted yet
+        std::vector<std::string> failed;
+        auto emit = [&](typename Unit::Kind kind) {
+            os.flush();
+            task.units.push_back(
+                {kind,
+                 kind == Unit::LogOnly ? llvm::orc::ThreadSafeModule()
+                                       : env->takeModule(),
+                 std::move(log), exprs, std::move(failed)});
+            log.clear();
+            failed.clear();
+            exprs = 0;
+        };
+        // ends a run of expressions, before anything else is compiled
+        auto flushExprs = [&] {
+            env->releaseOptimization();
+            if (exprs) emit(Unit::Expressions);
+        };
+
+        // the same loop as Driver::mainLoop()
+        while (true) {
+            int tok = parser.getCurToken();
+            if (!continuesExpressions(tok)) flushExprs();
+            switch (tok) {
+            case tokEof: {
+                if (!log.empty() || !failed.empty()) emit(Unit::LogOnly);
+                task.optStats = env->getOptStats();
+                std::chrono::duration<double> dt =
+                    std::chrono::steady_clock::now() - t0;
+                task.file.seconds = dt.count();
+                return;
+            }
+            case ';':
+                parser.getNextToken();
+                break;
+            case tokDef: {
+                size_t at = parser.getTokenIndex();
+                if (auto defAST = parser.parseDefinition()) {
+                    defAST->lower(flatCodegen_, astOpt_, task.stats.opt);
+                    task.stats.record(*defAST);
+                    // codegen hands the prototype over to the env
+                    SymbolId sym = defAST->getProto().getSymbol();
+                    if (auto *defIR = defAST->codegen()) {
+                        os << "Parsed a function definition.\n";
+                        defIR->print(os);
+                        os << "\n";
+                        emit(Unit::Definitions);
+                    } else {
+                        failed.emplace_back(Interner::global().str(sym));
+                    }
+                } else {
+                    // what scanPrototypes made of its prototype, if anything
+                    auto scanned = defNames_.find(at);
+                    if (scanned != defNames_.end())
+                        failed.push_back(scanned->second);
+                    parser.getNextToken();
+                }
+                break;
+            }
+            case tokExtern:
+                if (auto protoAST = parser.parseExtern()) {
+                    if (auto *protoIR = protoAST->codegen()) {
+                        os << "Read an extern: ";
+                        protoIR->print(os);
+                        os << "\n";
+                        env->addProto(protoAST);
+                    }
+                } else {
+                    parser.getNextToken();
+                }
+                break;
+            default:
+                if (auto fnAST = parser.parseTopLevelExpr()) {
+                    fnAST->lower(flatCodegen_, astOpt_, task.stats.opt);
+                    task.stats.record(*fnAST);
+                    if (exprBatch_) env->holdOptimization();
+                    if (auto *fnIR = fnAST->codegen()) {
+                        os << "Read a top-level expr: ";
+                        fnIR->print(os);
+                        os << "\n";
+                        fnIR->setName(exprEntryName(exprs++));
+                        if (!exprBatch_) emit(Unit::Expressions);
+                    }
+                } else {
+                    parser.getNextToken();
+                }
+                break;
+            }
+        }
+    }
+
+    void replay(Unit &unit) {
+        fputs(unit.log.c_str(), stderr);
+        for (const std::string &name : unit.failed) failed_.insert(name);
+        if (unit.kind != Unit::LogOnly && !canLink(unit)) return;
+        switch (unit.kind) {
+        case Unit::LogOnly:
+            break;
+        case Unit::Definitions:
+            exitOnErr_(sink_.definition(std::move(unit.module)));
+            break;
+        case Unit::Expressions:
+            exitOnErr_(sink_.expressions(std::move(unit.module), unit.exprs));
+            break;
+        }
+    }
+
+    // Whether unit's module can go to the JIT: not if it calls a def that
+    //  did not compile, which the JIT would fail to look up. Then its own
+    //  definitions go the same way, and a later one that compiles replaces
+    //  them.
+    bool canLink(Unit &unit) {
+        return unit.module.withModuleDo([&](llvm::Module &m) {
+            bool ok = llvm::none_of(m, [&](const llvm::Function &f) {
+                return f.isDeclaration() && failed_.contains(f.getName());
+            });
+            if (unit.kind == Unit::Definitions) {
+                for (const llvm::Function &f : m) {
+                    if (f.isDeclaration()) continue;
+                    if (ok)
+                        failed_.erase(f.getName());
+                    else
+                        failed_.insert(f.getName());
+                }
+            }
+            if (!ok) fputs("Error: unknown function referenced\n", stderr);
+            return ok;
+        });
+    }
+
+    // nullptr for files
+    std::shared_ptr<const TokenStream> tokens_;
+    ParserEnv<CT> *mainEnv_;
+    ModuleSink sink_;
+    const unsigned jobs_;
+    const bool flatCodegen_;
+    const bool astOpt_;
+    const bool exprBatch_;
+    const std::string dataLayout_;
+
+    std::unordered_map<
+        SymbolId,
+        std::vector<std::pair<size_t, std::unique_ptr<PrototypeAST<CT>>>>>
+        protos_;
+    // the name of the def at each chunk, as scanPrototypes parsed it
+    std::unordered_map<size_t, std::string> defNames_;
+    // defs that did not compile and nothing compiled since, by name; only
+    //  the main thread uses it, in replay()
+    llvm::StringSet<> failed_;
+
+    std::vector<Task> tasks_;
+
+    size_t numChunks_ = 0;
+    unsigned threads_ = 0;
+    double wallSeconds_ = 0;
+    AstStats astStats_;
+    OptStats optStats_;
+    llvm::ExitOnError exitOnErr_;
+};
@@ -12,17 +12,35 @@
     _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
    /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
  */
+#include "ast_stats.h"
+#include "batch_driver.h"
+#include "compile_ahead.h"
 #include "compiler_type.h"
+#include "huge_page_memory.h"
+#include "incremental_build.h"
+#include "interp_tier.h"
+#include "jit_optimizer.h"
+#include "object_cache.h"
+#include "options.h"
 #include "parser.h"
+#include "tiered_jit.h"
 #include <llvm-18/llvm/Support/Error.h>
 #include <llvm-18/llvm/Support/TargetSelect.h>
 #include <memory>
 
+
 template <CompilerType CT> class Driver {
 public:
-    Driver(bool enableOptimization, bool enableInteraction)
-        : enableOptimization_(enableOptimization),
-          enableInteraction_(enableInteraction) {
+    Driver(const CompilerOptions &opts,
+           std::unique_ptr<SourceBuffer> source = nullptr)
+        : enableInteraction_(opts.interactive),
+          optLevel_(opts.optLevel),
+          flatCodegen_(opts.flatCodegen), astOpt_(opts.astOpt),
+          lazy_(CT == CompilerType::JIT && opts.lazy),
+          // a prelude runs serially, into the env the files then see
+          batch_(opts.batch && !opts.multiFile()),
+          exprBatch_(CT == CompilerType::JIT && opts.exprBatch),
+          jobs_(opts.jobs) {
 
         if constexpr (CT == CompilerType::JIT) {
             llvm::InitializeNativeTarget();
@@ -32,13 +50,90 @@ public:
 
         if (enableInteraction_) fprintf(stderr, "ready> ");
 
-        parser_ = std::make_unique<Parser<CT>>(enableOptimization_);
+        // tiered, the env generates tier 0 code, which is not optimized;
+        //  lazy or on compile threads, the JIT optimizes what it compiles,
+        //  when and where it compiles it
+        bool jit = CT == CompilerType::JIT;
+        bool tiered = jit && opts.tiered;
+        unsigned compileThreads = jit ? opts.compileThreads : 0;
+        bool jitOpt = !tiered && (lazy_ || compileThreads);
+        llvm::orc::KaleidoscopeJITConfig jitConfig;
+        jitConfig.CompileThreads = compileThreads;
+        if (opts.targetCPU) jitConfig.CPU = opts.targetCPU;
+        if (opts.targetAttrs) jitConfig.Features = opts.targetAttrs;
+        if (jit) jitConfig.JITLinkSlabSize = (size_t)opts.jitlinkSlabMB << 20;
+        if (jit && opts.jitHugePages)
+            jitConfig.JITLinkMemory = [this,
+                                       slab = jitConfig.JITLinkSlabSize]() {
+                auto mm = std::make_unique<HugePageMemoryManager>(slab);
+                jitMemory_ = mm.get();
+                return mm;
+            };
+        if (jit && opts.cacheDir) {
+            objCache_ = std::make_unique<DiskObjectCache>(opts.cacheDir);
+            if (!objCache_->getError().empty()) {
+                fprintf(stderr, "warning: no object cache in %s: %s\n",
+                        opts.cacheDir, objCache_->getError().c_str());
+                objCache_.reset();
+            } else {
+                jitConfig.CacheFor =
+                    [this](const llvm::orc::JITTargetMachineBuilder &jtmb,
+                           llvm::CodeGenOptLevel level) {
+                        return objCache_->forTarget(jtmb, level);
+                    };
+            }
+        }
+        parser_ = std::make_unique<Parser<CT>>(
+            tiered || jitOpt ? 0 : optLevel_, std::move(source), jitConfig);
         pEnv_ = parser_->getEnv();
+        // reading stdin, the next item may not be typed in yet
+        if (!parser_->getTokens()) exprBatch_ = false;
+        if constexpr (CT == CompilerType::JIT) {
+            llvm::orc::KaleidoscopeJIT *pJIT = pEnv_->getJIT();
+            if (tiered)
+                tiered_ = std::make_unique<TieredJIT>(*pJIT, opts.hotCalls);
+            if (lazy_) exitOnErr_(pJIT->enableLazyCompilation());
+            if (jitOpt && optLevel_) {
+                jitOpt_ = std::make_unique<JITOptimizer>(optLevel_);
+                jitOpt_->attach(*pJIT);
+            }
+            // lazy and tiered compile when they see fit
+            if (compileThreads && !lazy_ && !tiered)
+                ahead_ = std::make_unique<CompileAhead>(*pJIT);
+            if (opts.interp)
+                interp_ = std::make_unique<InterpTier<CT>>(
+                    pEnv_, opts.interpHot,
+                    [this](llvm::orc::ThreadSafeModule tsm) {
+                        return addDefinition(std::move(tsm));
+                    });
+        }
     }
 
     // high level handling----------------------------------------------------
     void handleDefinition() {
+        size_t begin = parser_->getTokenIndex();
         if (auto defAST = parser_->parseDefinition()) {
+            if constexpr (CT == CompilerType::AOT) {
+                // nothing to lower for a def built before
+                if (incremental_ && incremental_->reuse(
+                                        *defAST, begin,
+                                        parser_->getTokenIndex()))
+                    return;
+            }
+            defAST->lower(flatCodegen_, astOpt_, astStats_.opt);
+            astStats_.record(*defAST);
+            if constexpr (CT == CompilerType::AOT) {
+                if (incremental_) {
+                    exitOnErr_(incremental_->rebuild(*defAST));
+                    return;
+                }
+            }
+            if constexpr (CT == CompilerType::JIT) {
+                if (interp_) {
+                    exitOnErr_(interp_->addDefinition(std::move(defAST)));
+                    return;
+                }
+            }
             if (auto *defIR = defAST->codegen()) {
                 fprintf(stderr, "Parsed a function definition.\n");
                 defIR->print(llvm::errs());
@@ -46,7 +141,11 @@ public:
                 if constexpr (CT == CompilerType::JIT) {
                     // transfer the newly defined function to the JIT
                     //  and open a new module
-                    pEnv_->transfer(nullptr);
+                    exitOnErr_(addDefinition(pEnv_->takeModule()));
+                } else {
+                    // for the modules after this one: the files after a
+                    //  -prelude
+                    defAST->declare();
                 }
             }
         } else {
@@ -61,10 +160,12 @@ public:
                 fprintf(stderr, "Read an extern: ");
                 protoIR->print(llvm::errs());
                 fprintf(stderr, "\n");
-                if constexpr (CT == CompilerType::JIT) {
-                    // add the prototype to _functionProtos
-                    pEnv_->addProto(protoAST);
+                if constexpr (CT == CompilerType::AOT) {
+                    // the defs after it may be in modules of their own
+                    if (incremental_) incremental_->addExtern(*protoAST);
                 }
+                // add the prototype to _functionProtos
+                pEnv_->addProto(protoAST);
             }
         } else {
             // Skip token for error recovery.
@@ -73,56 +174,71 @@ public:
     }
 
     void handleTopLevelExpression() {
-        // Evaluate a top-level expression into an anonymous function.]
-        llvm::orc::KaleidoscopeJIT *pJIT = pEnv_->getJIT();
-        if (auto fnAST = parser_->parseTopLevelExpr()) {
+        // Evaluate a top-level expression into an anonymous function. With
+        //  -expr-batch the JIT gathers the whole run of expressions up to
+        //  the next def, extern or the end into one module, an entry point
+        //  each, which is optimized, compiled and linked once.
+        unsigned count = 0;
+        if (exprBatch_) pEnv_->holdOptimization();
+        do {
+            if (parser_->getCurToken() == ';') {
+                parser_->getNextToken();
+                continue;
+            }
+            auto fnAST = parser_->parseTopLevelExpr();
+            if (!fnAST) {
+                // Skip token for error recovery.
+                parser_->getNextToken();
+                continue;
+            }
+            fnAST->lower(flatCodegen_, astOpt_, astStats_.opt);
+            astStats_.record(*fnAST);
+            if constexpr (CT == CompilerType::JIT) {
+                // -interp runs it, unless it is for the JIT
+                if (interp_ && exitOnErr_(interp_->runExpression(*fnAST)))
+                    continue;
+            }
             if (auto *fnIR = fnAST->codegen()) {
-                // if (fnAST->codegen()) {
                 fprintf(stderr, "Read a top-level expr: ");
                 fnIR->print(llvm::errs());
                 fprintf(stderr, "\n");
                 if constexpr (CT == CompilerType::JIT) {
-                    // create a ResourceTracker to track JIT's memory allocated
-                    //  to our anonymous expression, which we can free after
-                    //  execution
-                    auto rt = pJIT->getMainJITDylib().createResourceTracker();
-
-                    pEnv_->transfer(&rt);
-
-                    // search the jit for the _anon_expr symbol
-                    llvm::orc::ExecutorSymbolDef exprSymbol =
-                        exitOnErr_(pJIT->lookup("__anon_expr"));
-                    // assert(exprSymbol && "Function not found");
-
-                    // Get the symbol's address and cast it to the right type
-                    // (takes no
-                    //  arguments, returns a double) so we can call it as a
-                    //  native function.
-                    double (*fp)() =
-                        exprSymbol.getAddress().toPtr<double (*)()>();
-                    fprintf(stderr, "Evaluated to %f\n", fp());
-
-                    // remove the anonymous expression (the whole module) from
-                    // the JIT
-                    exitOnErr_(rt->remove());
+                    // frees the name __anon_expr for the next one
+                    fnIR->setName(exprEntryName(count++));
                 } else {
                     // remove the anonymous expression
                     fnIR->eraseFromParent();
                 }
             }
-        } else {
-            // Skip token for error recovery.
-            parser_->getNextToken();
-        }
+        } while (exprBatch_ && continuesExpressions(parser_->getCurToken()));
+
+        if (exprBatch_) pEnv_->releaseOptimization();
+        if constexpr (CT == CompilerType::JIT)
+            if (count) exitOnErr_(runExpressions(pEnv_->takeModule(), count));
     }
 
     //-------------------------------------------------------------------------
     /// top ::= definition | external | expression | ';'
     void mainLoop() {
+        // a pre-lexed file can be split up and compiled in parallel; the
+        //  AOT module is shared by all definitions, so it stays serial
+        if constexpr (CT == CompilerType::JIT) {
+            if (batch_ && parser_->getTokens()) {
+                batchDriver_ = std::make_unique<BatchDriver<CT>>(
+                    parser_->getTokens(), pEnv_, moduleSink(), jobs_,
+                    flatCodegen_, astOpt_, exprBatch_);
+                batchDriver_->run();
+                astStats_ += batchDriver_->getAstStats();
+                return;
+            }
+        }
         while (true) {
             if (enableInteraction_) fprintf(stderr, "ready> ");
             switch (parser_->getCurToken()) {
             case tokEof:
+                // all of the AOT output is one module, optimize it as such
+                if constexpr (CT == CompilerType::AOT)
+                    if (!incremental_) pEnv_->optimizeModule();
                 return;
             case ';': // ignore top-level semicolons.
                 parser_->getNextToken();
@@ -140,6 +256,42 @@ public:
         }
     }
 
+    // JIT, more than one input file: once mainLoop() has run the prelude,
+    //  compiles the files side by side, each seeing only the prelude, and
+    //  runs them in the order given
+    void compileFiles(std::vector<std::unique_ptr<SourceBuffer>> files,
+                      const std::vector<std::string> &names) {
+        filesDriver_ = std::make_unique<BatchDriver<CT>>(
+            std::move(files), names, pEnv_, moduleSink(), jobs_,
+            flatCodegen_, astOpt_, exprBatch_);
+        filesDriver_->run();
+        astStats_ += filesDriver_->getAstStats();
+    }
+
+    // AOT, more than one input file: what the workers of MultiFileBuild
+    //  did, for printStats()
+    void addStats(const AstStats &ast, const OptStats &opt) {
+        astStats_ += ast;
+        filesOpt_ += opt;
+    }
+
+    void printStats() const {
+        astStats_.print();
+        OptStats opt = pEnv_->getOptStats();
+        opt += filesOpt_;
+        if (batchDriver_) opt += batchDriver_->getOptStats();
+        if (filesDriver_) opt += filesDriver_->getOptStats();
+        if (jitOpt_) opt += jitOpt_->getStats();
+        opt.print();
+        if (batchDriver_) batchDriver_->printStats();
+        if (filesDriver_) filesDriver_->printStats();
+        if (tiered_) tiered_->printStats();
+        if (ahead_) ahead_->printStats();
+        if (interp_) interp_->printStats();
+        if (objCache_) objCache_->getStats().print();
+        if (jitMemory_) jitMemory_->getStats().print();
+    }
+
     Parser<CT> *getParser() __attribute__((always_inline)) {
         return parser_.get();
     }
@@ -148,10 +300,87 @@ public:
         return pEnv_;
     }
 
+    // AOT, -incremental: build takes the definitions from now on
+    void setIncrementalBuild(IncrementalBuild *build) { incremental_ = build; }
+
 private:
+    // JIT: hand a module to the JIT the way its mode wants it--------------
+    ModuleSink moduleSink() {
+        return {[this](llvm::orc::ThreadSafeModule tsm) {
+                    return addDefinition(std::move(tsm));
+                },
+                [this](llvm::orc::ThreadSafeModule tsm, unsigned count) {
+                    return runExpressions(std::move(tsm), count);
+                }};
+    }
+
+
+    llvm::Error addDefinition(llvm::orc::ThreadSafeModule tsm) {
+        if (tiered_) return tiered_->addDefinition(std::move(tsm));
+        if (lazy_) return pEnv_->getJIT()->addLazyModule(std::move(tsm));
+        if (ahead_) return ahead_->addDefinition(std::move(tsm));
+        return pEnv_->getJIT()->addModule(std::move(tsm));
+    }
+
+    // rt removes it once it ran
+    llvm::Error addExpression(llvm::orc::ThreadSafeModule tsm,
+                              llvm::orc::ResourceTrackerSP rt) {
+        if (tiered_)
+            return tiered_->addExpression(std::move(tsm), std::move(rt));
+        return pEnv_->getJIT()->addModule(std::move(tsm), std::move(rt));
+    }
+
+    // Runs the entry points of a module of top-level expressions in order,
+    //  then removes it from the JIT
+    llvm::Error runExpressions(llvm::orc::ThreadSafeModule tsm,
+                               unsigned count) {
+        llvm::orc::KaleidoscopeJIT *pJIT = pEnv_->getJIT();
+        // create a ResourceTracker to track JIT's memory allocated to our
+        //  anonymous expressions, which we can free after execution
+        auto rt = pJIT->getMainJITDylib().createResourceTracker();
+        if (auto err = addExpression(std::move(tsm), rt)) return err;
+        for (unsigned i = 0; i != count; ++i) {
+            // the first lookup compiles and links all of them
+            auto exprSymbol = pJIT->lookup(exprEntryName(i));
+            if (!exprSymbol) return exprSymbol.takeError();
+            // Get the symbol's address and cast it to the right type (takes
+            //  no arguments, returns a double) so we can call it as a
+            //  native function.
+            double (*fp)() = exprSymbol->getAddress().toPtr<double (*)()>();
+            fprintf(stderr, "Evaluated to %f\n", fp());
+        }
+        return rt->remove();
+    }
+
+    // JIT, -lazy and -compile-threads, and -cache-dir; declared before
+    //  parser_ to outlive the JIT that calls them
+    std::unique_ptr<JITOptimizer> jitOpt_;
+    std::unique_ptr<DiskObjectCache> objCache_;
     std::unique_ptr<Parser<CT>> parser_;
     ParserEnv<CT> *pEnv_;
+    // JIT, -tiered; declared after parser_ to stop its thread before the
+    //  JIT goes
+    std::unique_ptr<TieredJIT> tiered_;
+    // JIT, -compile-threads
+    std::unique_ptr<CompileAhead> ahead_;
+    // JIT, -interp
+    std::unique_ptr<InterpTier<CT>> interp_;
+    // JIT, -jit-huge-pages, owned by the JIT
+    HugePageMemoryManager *jitMemory_ = nullptr;
+    // AOT, -incremental
+    IncrementalBuild *incremental_ = nullptr;
     llvm::ExitOnError exitOnErr_;
     bool enableInteraction_;
-    bool enableOptimization_;
+    unsigned optLevel_;
+    bool flatCodegen_;
+    bool astOpt_;
+    bool lazy_;
+    bool batch_;
+    bool exprBatch_;
+    unsigned jobs_;
+    std::unique_ptr<BatchDriver<CT>> batchDriver_;
+    // JIT, more than one input file
+    std::unique_ptr<BatchDriver<CT>> filesDriver_;
+    AstStats astStats_;
+    OptStats filesOpt_;
 };
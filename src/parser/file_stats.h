@@ -0,0 +1,50 @@
+/*
+ * File: file_stats.h
+ * Path: /parser/file_stats.h
+ * Module: parser
+ * Lang: C/C++
+ * Created Date: Friday, October 23rd 2026, 2:47:18 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file times the input files compiled side by side for -stats.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// One of the input files, compiled by a worker thread of its own: lexed,
+//  parsed and lowered to IR, and for the AOT compiler to object code too
+struct FileStats {
+    std::string name;
+    size_t tokens = 0;
+    double seconds = 0;
+};
+
+// A line per file in command line order, after the totals: the wall clock
+//  time of all of them, and the time their workers took summed up, which
+//  is what one process per file would take without the startup
+inline void printFileStats(const std::vector<FileStats> &files,
+                           unsigned threads, double wallSeconds) {
+    double busy = 0;
+    size_t slowest = 0;
+    for (size_t i = 0; i != files.size(); ++i) {
+        busy += files[i].seconds;
+        if (files[i].seconds > files[slowest].seconds) slowest = i;
+    }
+    fprintf(stderr,
+            "files: %zu compiled on %u threads in %.2f ms, %.2f ms of work",
+            files.size(), threads, wallSeconds * 1e3, busy * 1e3);
+    if (!files.empty())
+        fprintf(stderr, ", slowest %s", files[slowest].name.c_str());
+    fprintf(stderr, "\n");
+    for (const FileStats &file : files)
+        fprintf(stderr, "files: %10.2f ms %10zu tokens  %s\n",
+                file.seconds * 1e3, file.tokens, file.name.c_str());
+}
@@ -0,0 +1,157 @@
+/*
+ * File: opt_pipeline.h
+ * Path: /parser/opt_pipeline.h
+ * Module: parser
+ * Lang: C/C++
+ * Created Date: Sunday, October 18th 2026, 4:47:15 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file keeps the optimization pipeline alive across modules.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include <llvm-18/llvm/IR/Module.h>
+#include <llvm-18/llvm/IR/PassInstrumentation.h>
+#include <llvm-18/llvm/Passes/OptimizationLevel.h>
+#include <llvm-18/llvm/Passes/PassBuilder.h>
+#include <llvm-18/llvm/Target/TargetMachine.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <optional>
+
+// Time spent in the optimizer, for -stats
+struct OptStats {
+    size_t pipelines = 0; // pass managers built
+    size_t modules = 0;   // optimized
+    double setupSeconds = 0;
+    double runSeconds = 0;
+
+    OptStats &operator+=(const OptStats &o) {
+        pipelines += o.pipelines;
+        modules += o.modules;
+        setupSeconds += o.setupSeconds;
+        runSeconds += o.runSeconds;
+        return *this;
+    }
+
+    void print() const {
+        if (!modules) return;
+        fprintf(stderr,
+                "opt: %zu modules in %.2f ms (%.1f us each), %zu pipeline "
+                "setups in %.2f ms (%.1f us each)\n",
+                modules, runSeconds * 1e3, runSeconds * 1e6 / modules,
+                pipelines, setupSeconds * 1e3,
+                setupSeconds * 1e6 / modules);
+    }
+};
+
+// A target machine for the cost model of a pipeline (TTI), one per
+//  pipeline, as a TargetMachine is not to be shared between threads;
+//  nullptr for the generic costs of no particular target
+using TargetMachineFactory =
+    std::function<std::unique_ptr<llvm::TargetMachine>()>;
+
+// The PassBuilder of one level (1-3) with its four analysis managers and
+//  all their registrations, set up once and run on any number of modules,
+//  whatever context they live in. Nothing kept here refers to a module or a
+//  context: the cached analysis results do, and they are dropped after
+//  every run, so the next module (maybe allocated where the last one was)
+//  starts clean.
+//
+//  The pass manager itself is built again for every module, as the default
+//  pipeline is not reusable: ModuleInlinerWrapperPass::run() moves its
+//  CGSCC pipeline into a pass manager it then runs, so a second run of the
+//  same instance gets nothing or, in older LLVMs, an ever longer list of
+//  emptied adaptors. That build is a small part of a run and is counted in
+//  the setup time.
+//
+//  As there is no single context to bind it to, there is no
+//  StandardInstrumentations; the callbacks only serve the PassBuilder.
+//  One per thread, like the module it runs on.
+//
+//  tm is the target the code is compiled for: without it the vectorizers,
+//  the unroller and the inliner see the no-op TTI, which knows of no vector
+//  registers and prices everything alike.
+class OptPipeline {
+public:
+    explicit OptPipeline(unsigned optLevel,
+                         std::unique_ptr<llvm::TargetMachine> tm = nullptr)
+        : tm_(std::move(tm)),
+          pb_(tm_.get(), tuningOptions(optLevel), std::nullopt, &pic_),
+          level_(level(optLevel)) {
+        auto t0 = std::chrono::steady_clock::now();
+        // Register the analyses the pipeline's passes ask for.----------------
+        pb_.registerModuleAnalyses(mam_);
+        pb_.registerCGSCCAnalyses(cgam_);
+        pb_.registerFunctionAnalyses(fam_);
+        pb_.registerLoopAnalyses(lam_);
+        pb_.crossRegisterProxies(lam_, fam_, cgam_, mam_);
+        stats_.setupSeconds += secondsSince(t0);
+    }
+
+    void run(llvm::Module &m) {
+        auto t0 = std::chrono::steady_clock::now();
+        llvm::ModulePassManager mpm =
+            pb_.buildPerModuleDefaultPipeline(level_);
+        ++stats_.pipelines;
+        auto t1 = std::chrono::steady_clock::now();
+        stats_.setupSeconds += secondsSince(t0);
+
+        mpm.run(m, mam_);
+        // the cached results point into m
+        lam_.clear();
+        fam_.clear();
+        cgam_.clear();
+        mam_.clear();
+        ++stats_.modules;
+        stats_.runSeconds += secondsSince(t1);
+    }
+
+    const OptStats &getStats() const __attribute__((always_inline)) {
+        return stats_;
+    }
+
+private:
+    // the vectorizers as in clang, from -O2 up
+    static llvm::PipelineTuningOptions tuningOptions(unsigned optLevel) {
+        llvm::PipelineTuningOptions pto;
+        pto.LoopVectorization = optLevel > 1;
+        pto.SLPVectorization = optLevel > 1;
+        return pto;
+    }
+
+    static llvm::OptimizationLevel level(unsigned optLevel) {
+        switch (optLevel) {
+        case 1:
+            return llvm::OptimizationLevel::O1;
+        case 2:
+            return llvm::OptimizationLevel::O2;
+        default:
+            return llvm::OptimizationLevel::O3;
+        }
+    }
+
+    static double secondsSince(std::chrono::steady_clock::time_point t0) {
+        std::chrono::duration<double> dt =
+            std::chrono::steady_clock::now() - t0;
+        return dt.count();
+    }
+
+    // in this order, so that each is destroyed before what it points to
+    std::unique_ptr<llvm::TargetMachine> tm_;
+    llvm::PassInstrumentationCallbacks pic_;
+    llvm::PassBuilder pb_;
+    llvm::LoopAnalysisManager lam_;
+    llvm::FunctionAnalysisManager fam_;
+    llvm::CGSCCAnalysisManager cgam_;
+    llvm::ModuleAnalysisManager mam_;
+    const llvm::OptimizationLevel level_;
+    OptStats stats_;
+};
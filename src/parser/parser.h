@@ -19,12 +19,16 @@
 #include "KaleidoSopceJIT.h"
 #include "ast.h"
 #include "compiler_type.h"
+#include "interner.h"
 #include "lexer.h"
 #include "logger.h"
 #include "parser_env.h"
+#include "source_buffer.h"
 #include "token.h"
+#include "token_stream.h"
 #include <cassert>
 #include <cctype>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
 #include <map>
@@ -33,9 +37,33 @@
 
 template <CompilerType CT> class Parser {
 public:
-    Parser() : enableOpt_(false) { initialize(); }
+    Parser() : optLevel_(0) { initialize(); }
 
-    Parser(bool enableOpt) : enableOpt_(enableOpt) { initialize(); }
+    Parser(unsigned optLevel) : optLevel_(optLevel) { initialize(); }
+
+    // pre-lex a whole source buffer instead of reading stdin; the JIT is
+    //  set up as jitConfig says
+    Parser(unsigned optLevel, std::unique_ptr<SourceBuffer> source,
+           const llvm::orc::KaleidoscopeJITConfig &jitConfig = {})
+        : optLevel_(optLevel), jitConfig_(jitConfig) {
+        if (source) tokens_ = Lexer(std::move(source)).tokenize();
+        initialize();
+    }
+
+    // parse an already lexed token buffer
+    Parser(unsigned optLevel, std::shared_ptr<const TokenStream> tokens)
+        : tokens_(std::move(tokens)), optLevel_(optLevel) {
+        initialize();
+    }
+
+    // parse only the tokens in [begin, end) of a buffer, as if the source
+    //  ended there, with an env set up by the caller (batch workers)
+    Parser(std::shared_ptr<const TokenStream> tokens, size_t begin, size_t end,
+           std::unique_ptr<ParserEnv<CT>> env)
+        : tokens_(std::move(tokens)), pos_(begin), end_(end),
+          env_(std::move(env)), optLevel_(env_->getOptLevel()) {
+        curTok_ = pos_ < end_ ? tokens_->kind(pos_) : tokEof;
+    }
 
     // Parser(bool enableOpt, Lexer &lexer)
     //     : enableOpt_(enableOpt), lexer_(std::move(lexer)) {
@@ -48,7 +76,34 @@ public:
         }
     }
 
-    int getNextToken() { return curTok_ = lexer_->getTok(); }
+    int getNextToken() {
+        if (tokens_)
+            return curTok_ = ++pos_ < end_ ? tokens_->kind(pos_) : tokEof;
+        return curTok_ = lexer_->getTok();
+    }
+
+    // payload of the current token
+    std::string_view getIdentifier() const {
+        return tokens_ ? tokens_->text(pos_) : lexer_->getIdentifier();
+    }
+    SymbolId getIdentifierSym() const {
+        return tokens_ ? tokens_->symbol(pos_) : lexer_->getIdentifierSym();
+    }
+    double getNumVal() const {
+        return tokens_ ? tokens_->numVal(pos_) : lexer_->getNumVal();
+    }
+
+    // lookahead and backtracking, only over a pre-lexed token buffer---------
+    int peekToken(size_t n = 1) const {
+        assert(tokens_ && "no lookahead when reading stdin");
+        return pos_ + n < end_ ? tokens_->kind(pos_ + n) : tokEof;
+    }
+    size_t getTokenIndex() const { return pos_; }
+    void rewind(size_t pos) {
+        assert(tokens_ && "no backtracking when reading stdin");
+        pos_ = pos;
+        curTok_ = pos_ < end_ ? tokens_->kind(pos_) : tokEof;
+    }
 
     // In order to parse binary expression correctly:
     // "x+y*z" -> "x+(y*z)"
@@ -64,7 +119,7 @@ public:
     }
 
     // For the parser funcs that are not the beginning of a line(like
-    //  parseBinOpRHS):
+    //  parseExpression):
     // e.g. need to parse:    A       B       C
     //  func should consider: ^
     //                        curTok
@@ -75,152 +130,201 @@ public:
 
     // handling basic expression units-----------------------------------------
     /// numberexpr ::= number
-    std::unique_ptr<ExprAST<CT>> parseNumberExpr() {
-        auto result = std::make_unique<NumberExprAST<CT>>(lexer_->getNumVal(),
-                                                          env_.get());
-        getNextToken();
-        return std::move(result);
-    }
-    /// parenexpr ::= '(' expression ')'
-    std::unique_ptr<ExprAST<CT>> parseParenExpr() {
-        getNextToken();
-        auto v = parseExpression();
-        if (!v) return nullptr;
-        if (curTok_ != ')') return LogErr<CT>("expected ')'");
+    ExprAST<CT> *parseNumberExpr() {
+        auto result = makeNode<NumberExprAST<CT>>(getNumVal());
         getNextToken();
-        return v;
+        return result;
     }
-    // identifierexpr
-    // ::= identifier
-    // ::= identifier '(' expression* ')'
-    std::unique_ptr<ExprAST<CT>> parseIdentifierExpr() {
-        std::string idName(lexer_->getIdentifierStr());
-        getNextToken(); // take in identifier
-        if (curTok_ != '(')
-            return std::make_unique<VariableExprAST<CT>>(idName, env_.get());
-
-        getNextToken(); // take in '('
-        std::vector<std::unique_ptr<ExprAST<CT>>> args;
-        if (curTok_ != ')') { // take in expression (args)
-            while (true) {
-                if (auto arg = parseExpression())
-                    args.push_back(std::move(arg));
-                else
-                    return nullptr;
-
-                if (curTok_ == ')') break;
-
-                if (curTok_ != ',')
-                    return LogErr<CT>("expected ')' or ',' in arg list");
-
-                getNextToken(); // take in ','
-            }
-        }
-
-        getNextToken(); // take in ')'
-        return std::make_unique<CallExprAST<CT>>(idName, std::move(args),
-                                                 env_.get());
-    }
-    /// primary
-    /// ::= identifierexpr
-    /// ::= numberexpr
-    /// ::= parenexpr
-    std::unique_ptr<ExprAST<CT>> parsePrimary() {
-        switch (curTok_) {
-        default:
-            return LogErr<CT>("unknown token when expection an expression");
-        case tokIdentifier:
-            return parseIdentifierExpr();
-        case tokNumber:
-            return parseNumberExpr();
-        case '(':
-            return parseParenExpr();
-        case tokIf:
-            return parseIfExpr();
-        case tokFor:
-            return parseForExpr();
-        }
-    }
-    /// expression
-    /// ::= primary binoprhs
-    std::unique_ptr<ExprAST<CT>> parseExpression() {
-        auto lhs = parseUnary();
-        if (lhs == nullptr) return nullptr;
-
-        return parseBinOpRHS(0, std::move(lhs));
-    }
-    //-------------------------------------------------------------------------
 
-    // handling binary/unary expressions---------------------------------------------
+    // handling expressions----------------------------------------------------
+    /// expression ::= unary binoprhs
+    /// binoprhs   ::= (binop unary)*
+    /// unary      ::= primary | op unary
+    /// primary    ::= number
+    ///            ::= identifier
+    ///            ::= identifier '(' (expression (',' expression)*)? ')'
+    ///            ::= '(' expression ')'
+    ///            ::= 'if' expression 'then' expression ('else' expression)?
+    ///            ::= 'for' identifier '=' expression ',' expression
+    ///                (',' expression)? 'do' expression
     //
+    // The whole grammar is parsed without recursion, so the nesting depth of
+    //  the input is bounded by the heap instead of the thread stack. Every
+    //  construct that is still waiting for parts (a binary operator for its
+    //  RHS, a prefix operator for its operand, a parenthesis, the args of a
+    //  call, the parts of an if/for) is a Frame on frames_, and the finished
+    //  parts it already has wait on operands_.
+    //
+    // Binary operators are handled by operator precedence: e.g. for
+    //  a + b * c - d, '+' waits on the stack while b * c is built, as '*'
+    //  binds tighter; when '-' comes, everything pending that binds at least
+    //  as tightly ('*', then '+') is merged first, which makes operators of
+    //  the same precedence left associative: ((a + (b * c)) - d).
+    ExprAST<CT> *parseExpression() {
+        frames_.clear();
+        operands_.clear();
 
-    /// unary
-    ///   ::= primary
-    ///   ::= '!' unary
-    std::unique_ptr<ExprAST<CT>> parseUnary() {
-        // if cur token isnt an operator, it must be a primary expr
-        if (!isascii(curTok_) || curTok_ == '(' || curTok_ == ',')
-            return parsePrimary();
-        
-        // if this is a unary operator, read it
-        int opc = curTok_;
-        getNextToken();
-        if (auto operand = parseUnary())
-            // recursive for code like "!!x"
-            return std::make_unique<UnaryExprAST<CT>>(opc, std::move(operand), env_.get());
-        return nullptr;
-    }
-
-    /// binoprhs
-    /// ::= ('+' primary)*
-    /*
-    e.g. When parsing a + b + (c + d):
-        lhs == a
-        curTok == +
-        then parse the rest to find possible rhs
-        rhs == parsePrimary() == b
-        now curTok == + (the second) and its prec is nextPrec
-        then if (tokPrec < nextPrec):
-            we move on to parse b + (c + d) as a whole rhs by recursion call
-            that is a + (b + (c + d))
-        else:
-            we combine (a + b) as lhs
-            that is (a + b) + (c + d)
-    */
-    std::unique_ptr<ExprAST<CT>>
-    parseBinOpRHS(int exprPrec, std::unique_ptr<ExprAST<CT>> lhs) {
-        // The precedence value passed into ParseBinOpRHS indicates the minimal
-        //  operator precedence that the function is allowed to eat
         while (true) {
-            int tokPrec = getTokPrecedence();
-            // guard: checking current precedence and detect whether
-            //  the token runs out of operators
-            if (tokPrec < exprPrec) return lhs;
-            // else we know that this token is binary and should be included
-            int binOp = curTok_;
-
-            // Then get next token and parse the primary expression
-            //  after the binary operator
-            getNextToken();
-            auto rhs = parseUnary();
-            if (!rhs) return nullptr;
-            // If binOp binds less tightly with RHS than the operator after RHS,
-            // let
-            //  the pending operator take RHS as its LHS.
-            int nextPrec = getTokPrecedence();
-            if (tokPrec < nextPrec) {
-                rhs = parseBinOpRHS(tokPrec + 1, std::move(rhs));
-                if (!rhs) return nullptr;
+            // read an operand----------------------------------------------
+            ExprAST<CT> *e = nullptr;
+            while (!e) {
+                // if cur token isnt an operator, it must be a primary expr
+                if (isascii(curTok_) && curTok_ != '(' && curTok_ != ',') {
+                    frames_.push_back({Frame::Unary, 0, curTok_});
+                    getNextToken();
+                    continue;
+                }
+                switch (curTok_) {
+                default:
+                    return LogErr<CT>(
+                        "unknown token when expection an expression");
+                case tokNumber:
+                    e = parseNumberExpr();
+                    break;
+                case tokIdentifier: {
+                    SymbolId idName = getIdentifierSym();
+                    getNextToken(); // take in identifier
+                    if (curTok_ != '(') {
+                        e = makeNode<VariableExprAST<CT>>(idName);
+                        break;
+                    }
+                    getNextToken(); // take in '('
+                    if (curTok_ == ')') {
+                        getNextToken(); // take in ')'
+                        e = makeNode<CallExprAST<CT>>(
+                            idName, ArenaArray<ExprAST<CT> *>());
+                        break;
+                    }
+                    // args of nested calls are pushed above ours, and
+                    //  popped before we go on, so all calls share one
+                    //  scratch vector
+                    frames_.push_back(
+                        {Frame::Call, 0, 0, 0, idName, argScratch_.size()});
+                    break;
+                }
+                case '(':
+                    getNextToken(); // take in '('
+                    frames_.push_back({Frame::Paren});
+                    break;
+                case tokIf:
+                    getNextToken(); // take in "if"
+                    frames_.push_back({Frame::If});
+                    break;
+                case tokFor: {
+                    getNextToken(); // take in "for"
+                    if (curTok_ != tokIdentifier)
+                        return LogErr<CT>("expected identifier after for");
+                    SymbolId idName = getIdentifierSym();
+                    getNextToken(); // take in identifier
+                    if (curTok_ != '=')
+                        return LogErr<CT>("expected \"=\" after for");
+                    getNextToken(); // take in "="
+                    frames_.push_back({Frame::For, 0, 0, 0, idName});
+                    break;
+                }
+                }
             }
 
-            // Merge LHS/RHS.
-            lhs = std::make_unique<BinaryExprAST<CT>>(
-                binOp, std::move(lhs), std::move(rhs), env_.get());
-            // This will turn "a+b+" into "(a+b)" and execute the next iteration
-            // of
-            //  the loop, with "+" as the current token
+            // finish what the operand completes----------------------------
+            while (true) {
+                // prefix operators bind tighter than any binary operator
+                while (!frames_.empty() && frames_.back().kind == Frame::Unary) {
+                    e = makeNode<UnaryExprAST<CT>>(frames_.back().op, e);
+                    frames_.pop_back();
+                }
+
+                int tokPrec = getTokPrecedence();
+                if (tokPrec > 0) {
+                    e = reduceBinOps(e, tokPrec);
+                    operands_.push_back(e);
+                    frames_.push_back({Frame::BinOp, 0, curTok_, tokPrec});
+                    getNextToken(); // take in the operator
+                    break;
+                }
+
+                // not an operator: the innermost open expression ends here
+                e = reduceBinOps(e, 0);
+                if (frames_.empty()) return e;
+                Frame &f = frames_.back();
+                if (f.kind == Frame::Paren) {
+                    if (curTok_ != ')') return LogErr<CT>("expected ')'");
+                    getNextToken(); // take in ')'
+                    frames_.pop_back();
+                    continue;
+                }
+                if (f.kind == Frame::Call) {
+                    argScratch_.push_back(e);
+                    if (curTok_ == ',') {
+                        getNextToken(); // take in ','
+                        break;
+                    }
+                    if (curTok_ != ')')
+                        return LogErr<CT>("expected ')' or ',' in arg list");
+                    getNextToken(); // take in ')'
+                    auto args = arena_->copyArray(
+                        argScratch_.data() + f.argsBegin,
+                        argScratch_.data() + argScratch_.size());
+                    argScratch_.resize(f.argsBegin);
+                    e = makeNode<CallExprAST<CT>>(f.sym, args);
+                    frames_.pop_back();
+                    continue;
+                }
+                if (f.kind == Frame::If) {
+                    if (f.stage == 0) { // cond
+                        if (curTok_ != tokThen)
+                            return LogErr<CT>("expected \"then\" after \"if\"");
+                        getNextToken(); // take in "then"
+                        operands_.push_back(e);
+                        f.stage = 1;
+                        break;
+                    }
+                    if (f.stage == 1 && curTok_ == tokElse) { // then
+                        getNextToken(); // take in "else"
+                        operands_.push_back(e);
+                        f.stage = 2;
+                        break;
+                    }
+                    ExprAST<CT> *elsee = nullptr;
+                    if (f.stage == 2) {
+                        elsee = e;
+                        e = popOperand();
+                    }
+                    ExprAST<CT> *cond = popOperand();
+                    e = elsee ? makeNode<IfExprAST<CT>>(cond, e, elsee)
+                              : makeNode<IfExprAST<CT>>(cond, e);
+                    frames_.pop_back();
+                    continue;
+                }
+                // Frame::For
+                if (f.stage == 0) { // start
+                    if (curTok_ != ',')
+                        return LogErr<CT>("expected ',' after for start value");
+                    getNextToken(); // take in ","
+                    operands_.push_back(e);
+                    f.stage = 1;
+                    break;
+                }
+                if (f.stage == 1 || f.stage == 2) { // end, optional step
+                    operands_.push_back(e);
+                    if (f.stage == 1 && curTok_ == ',') {
+                        getNextToken(); // take in ","
+                        f.stage = 2;
+                        break;
+                    }
+                    if (f.stage == 1) operands_.push_back(nullptr); // no step
+                    if (curTok_ != tokDo)
+                        return LogErr<CT>("expected \"do\" after for");
+                    getNextToken(); // take in "do"
+                    f.stage = 3;
+                    break;
+                }
+                ExprAST<CT> *step = popOperand();
+                ExprAST<CT> *end = popOperand();
+                ExprAST<CT> *start = popOperand();
+                e = makeNode<ForExprAST<CT>>(f.sym, start, end, step, e);
+                frames_.pop_back();
+            }
         }
-        // loop around to the top of the while loop.
     }
     //-------------------------------------------------------------------------
 
@@ -230,7 +334,7 @@ public:
     /// ::= binary LETTER number? (id, id)
     std::unique_ptr<PrototypeAST<CT>> parsePrototype() {
         // func name
-        std::string fnName;
+        SymbolId fnName;
         PrototypeType kind = PrototypeType::NonOp;
         unsigned binaryPrecedence = 30;
 
@@ -238,7 +342,7 @@ public:
         default:
             return LogErrP<CT>("expected function name in function prototype");
         case (tokIdentifier):
-            fnName = lexer_->getIdentifierStr();
+            fnName = getIdentifierSym();
             // kind = 0;
             // '(' before arg list
             getNextToken();
@@ -247,8 +351,7 @@ public:
             getNextToken();
             if (!isascii(curTok_))
                 return LogErrP<CT>("expected unary operator");
-            fnName = "unary";
-            fnName += (char)curTok_;
+            fnName = Interner::global().unaryOp((char)curTok_);
             kind = PrototypeType::Unary;
             getNextToken();
             break;
@@ -258,14 +361,13 @@ public:
             if (!isascii(curTok_)) {
                 return LogErrP<CT>("expected binary operator");
             }
-            fnName = "binary";
-            fnName += (char)curTok_;
+            fnName = Interner::global().binaryOp((char)curTok_);
             kind = PrototypeType::Binary;
 
             // number? as precedence
             getNextToken();
-            double curNumVal = lexer_->getNumVal();
             if (curTok_ == tokNumber) { // if defining precedence
+                double curNumVal = getNumVal();
                 if (curNumVal < 1 || curNumVal > 100)
                     return LogErrP<CT>("Invalid precedence: must be 1..100");
                 binaryPrecedence = (unsigned)curNumVal;
@@ -287,9 +389,9 @@ public:
             return LogErrP<CT>("expected '(' in function prototype");
 
         // arglist
-        std::vector<std::string> argNames;
+        std::vector<SymbolId> argNames;
         while (getNextToken() == tokIdentifier)
-            argNames.push_back(lexer_->getIdentifierStr());
+            argNames.push_back(getIdentifierSym());
 
         // ')' after arg list
         if (curTok_ != ')')
@@ -337,10 +439,11 @@ public:
         auto proto = parsePrototype();
         if (!proto) return nullptr;
 
+        newArena();
         auto E = parseExpression();
         if (!E) return nullptr;
-        return std::make_unique<FunctionAST<CT>>(std::move(proto), std::move(E),
-                                                 env_.get());
+        return std::make_unique<FunctionAST<CT>>(std::move(proto), E,
+                                                 std::move(arena_), env_.get());
     }
 
     /// external ::= 'extern' prototype
@@ -350,79 +453,11 @@ public:
     }
     //-------------------------------------------------------------------------
 
-    // handling control flows--------------------------------------------------
-    /// ifexpr
-    /// ::= 'if' expr 'then' expr ('else' expr)
-    std::unique_ptr<ExprAST<CT>> parseIfExpr() {
-        getNextToken(); // take in "if" & move on
-        auto cond = parseExpression();
-        if (!cond) return nullptr;
-
-        if (curTok_ != tokThen) {
-            return LogErr<CT>("expected \"then\" after \"if\"");
-        }
-        getNextToken(); // take in "then" & move on
-
-        auto then = parseExpression();
-        if (!then) return nullptr;
-
-        if (curTok_ != tokElse)
-            return std::make_unique<IfExprAST<CT>>(std::move(cond),
-                                                   std::move(then), env_.get());
-        getNextToken(); // take in "else" & move on
-
-        auto elsee = parseExpression();
-        if (!elsee) return nullptr;
-
-        return std::make_unique<IfExprAST<CT>>(std::move(cond), std::move(then),
-                                               std::move(elsee), env_.get());
-    }
-    /// forexpr
-    /// ::= 'fo=r' identifier '' expr ',' expr (',' expr)? 'do' expression
-    std::unique_ptr<ExprAST<CT>> parseForExpr() {
-        getNextToken(); // take in "for" and move on
-        if (curTok_ != tokIdentifier)
-            return LogErr<CT>("expected identifier after for");
-
-        std::string idName = lexer_->getIdentifierStr();
-        getNextToken(); // take in identifier and move on
-
-        if (curTok_ != '=') return LogErr<CT>("expected \"=\" after for");
-        getNextToken(); // take in "=" and move on
-
-        auto start = parseExpression();
-        if (!start) return nullptr;
-        if (curTok_ != ',')
-            return LogErr<CT>("expected ',' after for start value");
-        getNextToken(); // take in ","
-
-        auto end = parseExpression();
-        if (!end) return nullptr;
-
-        // step is optional
-        std::unique_ptr<ExprAST<CT>> step;
-        if (curTok_ == ',') {
-            getNextToken(); // take in ","
-            step = parseExpression();
-            if (!step) return nullptr;
-        }
-
-        if (curTok_ != tokDo) return LogErr<CT>("expected \"do\" after for");
-        getNextToken(); // take in "do"
-
-        auto body = parseExpression();
-        if (!body) return nullptr;
-
-        return std::make_unique<ForExprAST<CT>>(idName, std::move(start),
-                                                std::move(end), std::move(step),
-                                                std::move(body), env_.get());
-    }
-    //-------------------------------------------------------------------------
-
     //-------------------------------------------------------------------------
     /// toplevelexpr ::= expression
     /// interface for driver
     std::unique_ptr<FunctionAST<CT>> parseTopLevelExpr() {
+        newArena();
         auto E = parseExpression();
         if (!E) return nullptr;
 
@@ -431,36 +466,95 @@ public:
             // std::make_unique<PrototypeAST>("", std::vector<std::string>(),
             // this);
             std::make_unique<PrototypeAST<CT>>(
-                "__anon_expr", std::vector<std::string>(), env_.get());
-        return std::make_unique<FunctionAST<CT>>(std::move(proto), std::move(E),
-                                                 env_.get());
+                Interner::symAnonExpr, std::vector<SymbolId>(), env_.get());
+        return std::make_unique<FunctionAST<CT>>(std::move(proto), E,
+                                                 std::move(arena_), env_.get());
     }
 
     // helper func----------------------------------------------------
+    // every expression node of the definition being parsed goes to arena_
+    template <typename T, typename... Args> T *makeNode(Args &&...args) {
+        return arena_->make<T>(std::forward<Args>(args)..., env_.get());
+    }
+
+    // merge the pending binary operators of the innermost open expression
+    //  that bind at least as tightly as minPrec, rhs being the last operand
+    ExprAST<CT> *reduceBinOps(ExprAST<CT> *rhs, int minPrec) {
+        while (!frames_.empty() && frames_.back().kind == Frame::BinOp &&
+               frames_.back().prec >= minPrec) {
+            ExprAST<CT> *lhs = popOperand();
+            rhs = makeNode<BinaryExprAST<CT>>(frames_.back().op, lhs, rhs);
+            frames_.pop_back();
+        }
+        return rhs;
+    }
+
+    ExprAST<CT> *popOperand() {
+        ExprAST<CT> *e = operands_.back();
+        operands_.pop_back();
+        return e;
+    }
+
+    void newArena() {
+        arena_ = std::make_unique<AstArena>();
+        argScratch_.clear();
+    }
 
     void initialize() {
         // binoPrecedence_ = {{'<', 10}, {'+', 20}, {'-', 20}, {'*', 40}};
 
-        lexer_ = std::make_unique<Lexer>();
-
-        getNextToken();
+        if (tokens_) {
+            pos_ = 0;
+            curTok_ = tokens_->kind(pos_);
+        } else {
+            lexer_ = std::make_unique<Lexer>();
+            getNextToken();
+        }
 
-        env_ = std::make_unique<ParserEnv<CT>>(enableOpt_);
-        env_->initialize();
+        env_ = std::make_unique<ParserEnv<CT>>(optLevel_);
+        env_->initialize(jitConfig_);
     }
 
     int getCurToken() const __attribute__((always_inline)) { return curTok_; }
+    // nullptr when reading stdin
+    const std::shared_ptr<const TokenStream> &getTokens() const
+        __attribute__((always_inline)) {
+        return tokens_;
+    }
     ParserEnv<CT> *getEnv() const __attribute__((always_inline)) {
         return env_.get();
     }
 
 private:
+    // exactly one of these is set: the stdin lexer for the REPL, or the
+    //  pre-lexed tokens of a source file with the index of curTok_
     std::unique_ptr<Lexer> lexer_;
+    std::shared_ptr<const TokenStream> tokens_;
+    size_t pos_ = 0;
+    // tokens from end_ on read as tokEof
+    size_t end_ = SIZE_MAX;
     int curTok_;
     // this holds the precedence for each binary operator that we define
     // std::map<char, int> binoPrecedence_;
     std::unique_ptr<ParserEnv<CT>> env_;
-    const bool enableOpt_;
+    // nodes of the current definition, handed over to its FunctionAST
+    std::unique_ptr<AstArena> arena_;
+    std::vector<ExprAST<CT> *> argScratch_;
+    // explicit stacks of parseExpression()
+    struct Frame {
+        enum Kind : uint8_t { BinOp, Unary, Paren, Call, If, For } kind;
+        uint8_t stage = 0; // which part of an if/for comes next
+        int op = 0;        // BinOp, Unary
+        int prec = 0;      // BinOp
+        SymbolId sym = kNoSymbol; // Call callee, For variable
+        size_t argsBegin = 0;     // Call, first arg in argScratch_
+    };
+    std::vector<Frame> frames_;
+    std::vector<ExprAST<CT> *> operands_;
+    // 0-3, as -O0 to -O3
+    const unsigned optLevel_;
+    // of the JIT the env creates
+    const llvm::orc::KaleidoscopeJITConfig jitConfig_;
 };
 
 // Install standard binary operators: 1 is lowest precedence
@@ -15,32 +15,54 @@
 #pragma once
 #include "KaleidoSopceJIT.h"
 #include "compiler_type.h"
+#include "interner.h"
+#include "opt_pipeline.h"
 #include "prototype_ast.h"
+#include "scoped_symbol_table.h"
 #include <llvm-18/llvm/IR/LLVMContext.h>
 #include <llvm-18/llvm/IR/Module.h>
-#include <llvm-18/llvm/Passes/PassBuilder.h>
-#include <llvm-18/llvm/Passes/StandardInstrumentations.h>
-#include <llvm-18/llvm/Transforms/AggressiveInstCombine/AggressiveInstCombine.h>
-#include <llvm-18/llvm/Transforms/InstCombine/InstCombine.h>
-#include <llvm-18/llvm/Transforms/Scalar.h>
-#include <llvm-18/llvm/Transforms/Scalar/GVN.h>
-#include <llvm-18/llvm/Transforms/Scalar/Reassociate.h>
-#include <llvm-18/llvm/Transforms/Scalar/SimplifyCFG.h>
+#include <functional>
 #include <map>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+// Where a batch worker finds the prototypes declared before its part of the
+//  source (see BatchDriver)
+template <CompilerType CT>
+using OuterProtoLookup = std::function<const PrototypeAST<CT> *(SymbolId)>;
+
 template <CompilerType CT> class ParserEnv {
 public:
-    ParserEnv() : enableOpt_(false) {}
-    ParserEnv(bool enableOpt) : enableOpt_(enableOpt) {}
+    ParserEnv() : optLevel_(0) {}
+    ParserEnv(unsigned optLevel) : optLevel_(optLevel) {}
 
-    void initialize() {
+    void initialize(const llvm::orc::KaleidoscopeJITConfig &jitConfig = {}) {
         binoPrecedence_ = {{'<', 10}, {'+', 20}, {'-', 20}, {'*', 40}};
-        if constexpr (CT == CompilerType::JIT)
-            theJIT_ = exitOnErr_(llvm::orc::KaleidoscopeJIT::Create());
+        if constexpr (CT == CompilerType::JIT) {
+            theJIT_ =
+                exitOnErr_(llvm::orc::KaleidoscopeJIT::Create(jitConfig));
+            makeTargetMachine_ = [this] {
+                return exitOnErr_(theJIT_->createTargetMachine());
+            };
+        }
+        initializeModule();
+    }
+
+    // An env for a batch worker thread: no JIT of its own, modules are
+    //  handed out with takeModule(), and the operator precedences,
+    //  prototypes of the earlier source and target of the pipeline are
+    //  given by the caller.
+    void initializeWorker(const std::string &dataLayout,
+                          const std::map<char, int> &precedence,
+                          OuterProtoLookup<CT> outerProtos,
+                          TargetMachineFactory makeTargetMachine) {
+        binoPrecedence_ = precedence;
+        dataLayout_ = dataLayout;
+        outerProtos_ = std::move(outerProtos);
+        makeTargetMachine_ = std::move(makeTargetMachine);
         initializeModule();
-        if (enableOpt_) initializePassManager();
     }
 
     void initializeModule() {
@@ -49,81 +71,104 @@ public:
         theContext_ = std::make_unique<llvm::LLVMContext>();
         theModule_ =
             std::make_unique<llvm::Module>("KaleidoScopeJIT", *theContext_);
-        if constexpr (CT == CompilerType::JIT)
+        if (theJIT_)
             theModule_->setDataLayout(theJIT_->getDataLayout());
+        else if (!dataLayout_.empty())
+            theModule_->setDataLayout(dataLayout_);
 
         // create a new builder for the module---------------------------------
         builder_ = std::make_unique<llvm::IRBuilder<>>(*theContext_);
     }
 
+    // The pipeline is built once per env, for the first module it
+    //  optimizes, and reused for every module after, see OptPipeline.
+    //  Never called at -O0.
     void initializePassManager() {
-        // create new pass and analysis managers
-        theFPM_ = std::make_unique<llvm::FunctionPassManager>();
-        theLAM_ = std::make_unique<llvm::LoopAnalysisManager>();
-        theFAM_ = std::make_unique<llvm::FunctionAnalysisManager>();
-        theCGAM_ = std::make_unique<llvm::CGSCCAnalysisManager>();
-        theMAM_ = std::make_unique<llvm::ModuleAnalysisManager>();
-        thePIC_ = std::make_unique<llvm::PassInstrumentationCallbacks>();
-        theSI_ = std::make_unique<llvm::StandardInstrumentations>(
-            *theContext_, /*DebugLogging*/ true);
-        theSI_->registerCallbacks(*thePIC_, theMAM_.get());
-
-        // Add transform passes.-----------------------------------------------
-        // Do simple "peephole" optimizations and bit-twiddling optzns.
-        theFPM_->addPass(llvm::InstCombinePass());
-        // _theFPM->addPass(llvm::AggressiveInstCombinePass());
-        // Reassociate expressions.
-        theFPM_->addPass(llvm::ReassociatePass());
-        // Eliminate Common SubExpressions.
-        theFPM_->addPass(llvm::GVNPass());
-        // Simplify the control flow graph (deleting unreachable blocks, etc).
-        theFPM_->addPass(llvm::SimplifyCFGPass());
-        // // Run InstCombine again to catch any new opportunities.
-        // _theFPM->addPass(llvm::InstCombinePass());
-
-        // Register analysis passes used in these transform passes.------------
-        pb_.registerModuleAnalyses(*theMAM_);
-        pb_.registerFunctionAnalyses(*theFAM_);
-        pb_.crossRegisterProxies(*theLAM_, *theFAM_, *theCGAM_, *theMAM_);
+        if (!opt_)
+            opt_ = std::make_unique<OptPipeline>(
+                optLevel_,
+                makeTargetMachine_ ? makeTargetMachine_() : nullptr);
+    }
+
+    // The target the pipeline tunes for: the JIT's own, else (AOT) the
+    //  backend's, set before the first module is optimized; without one,
+    //  the generic costs of no target
+    void setTargetMachineFactory(TargetMachineFactory makeTargetMachine) {
+        makeTargetMachine_ = std::move(makeTargetMachine);
+    }
+
+    const TargetMachineFactory &getTargetMachineFactory() const
+        __attribute__((always_inline)) {
+        return makeTargetMachine_;
     }
 
     // =========================helper funcs===================================
-    void runOpt(llvm::Function *theFunction) {
-        theFPM_->run(*theFunction, *theFAM_);
+    // Run the pipeline over the whole current module. The JIT calls it for
+    //  every definition, which has a module of its own; the AOT compiler
+    //  once on the whole program, so that it can inline across definitions.
+    void optimizeModule() {
+        if (!optLevel_) return;
+        if (optHeld_) {
+            optPending_ = true;
+            return;
+        }
+        initializePassManager();
+        opt_->run(*theModule_);
+    }
+
+    // Between these, optimizeModule() only notes that it was called, and
+    //  the release runs it once for all of them: the JIT driver gathers a
+    //  run of top-level expressions into one module (-expr-batch).
+    void holdOptimization() { optHeld_ = true; }
+    void releaseOptimization() {
+        optHeld_ = false;
+        if (optPending_) {
+            optPending_ = false;
+            optimizeModule();
+        }
     }
 
     void addProto(std::unique_ptr<PrototypeAST<CT>> &protoAST) {
-        functionProtos_[protoAST->getName()] = std::move(protoAST);
+        functionProtos_[protoAST->getSymbol()] = std::move(protoAST);
+    }
+
+    // the prototype that getFunction() would declare name from, if any
+    const PrototypeAST<CT> *getProto(SymbolId name) const {
+        auto fi = functionProtos_.find(name);
+        return fi == functionProtos_.end() ? nullptr : fi->second.get();
     }
 
-    llvm::Function *getFunction(std::string name) {
+    llvm::Function *getFunction(SymbolId name) {
         // check if the function has been added to the current module
-        if (auto *f = theModule_->getFunction(name)) return f;
+        if (auto *f = theModule_->getFunction(Interner::global().str(name)))
+            return f;
         // if not, check whether we can codegenthe declaration from prototype
         auto fi = functionProtos_.find(name);
         if (fi != functionProtos_.end()) return fi->second->codegen();
+        if (outerProtos_)
+            if (const PrototypeAST<CT> *p = outerProtos_(name))
+                return p->codegen(this);
 
         // if no existing prototype exists, return null;
         return nullptr;
     }
 
+    // drops all named values, before binding the arguments of a function
     void clearNamedValues() { namedValues_.clear(); }
 
-    // transfer the newly defined function to the JIT
-    //  and open a new module
-    void transfer(llvm::orc::ResourceTrackerSP *rt) {
+    // values bound after pushScope() are unbound by the matching
+    //  popScope(), which also brings back what they shadowed
+    void pushScope() { namedValues_.pushScope(); }
+    void popScope() { namedValues_.popScope(); }
+
+
+    // hand out the current module together with its context and open a new
+    //  one
+    llvm::orc::ThreadSafeModule takeModule() {
         auto tsm = llvm::orc::ThreadSafeModule(std::move(theModule_),
                                                std::move(theContext_));
-        if (rt != nullptr)
-            // addModule triggers code generation for all the functions
-            //  in the module, and accepts a ResourceTracker which can
-            //  be used to remove the module from the JIT later.
-            this->exitOnErr_(theJIT_->addModule(std::move(tsm), *rt));
-        else {
-            this->exitOnErr_(theJIT_->addModule(std::move(tsm)));
-        }
         initializeModule();
-        if (enableOpt_) initializePassManager();
+        return tsm;
     }
 
     // =========================set & get===================================
@@ -143,16 +188,21 @@ public:
         return theJIT_.get();
     }
 
-    llvm::Value *getValue(const std::string &name) const __attribute__((always_inline)) {
-        auto tar = namedValues_.find(name);
-        if (tar != namedValues_.end()) {
-            return tar->second;
-        }
-        return nullptr;
+    llvm::Value *getValue(SymbolId name) const __attribute__((always_inline)) {
+        return namedValues_.lookup(name);
+    }
+
+    unsigned getOptLevel() const __attribute__((always_inline)) {
+        return optLevel_;
     }
 
-    constexpr bool getEnableOpt() const __attribute__((always_inline)) {
-        return enableOpt_;
+    OptStats getOptStats() const {
+        return opt_ ? opt_->getStats() : OptStats();
+    }
+
+    const std::map<char, int> &getBinoPrecedences() const
+        __attribute__((always_inline)) {
+        return binoPrecedence_;
     }
 
     int getBinoPrecedence(const char k) const __attribute__((always_inline)) {
@@ -162,13 +212,8 @@ public:
         return -1;
     }
 
-    void setValue(const std::string &k, llvm::Value *v)
-        __attribute__((always_inline)) {
-        namedValues_[k] = v;
-    }
-
-    void rmValue(const std::string &k) __attribute__((always_inline)) {
-        namedValues_.erase(k);
+    void setValue(SymbolId k, llvm::Value *v) __attribute__((always_inline)) {
+        namedValues_.bind(k, v);
     }
 
     void setBinoPrecedence(const char k, const int v) __attribute__((always_inline)) {
@@ -181,23 +226,23 @@ private:
     std::unique_ptr<llvm::LLVMContext> theContext_;
     std::unique_ptr<llvm::IRBuilder<>> builder_;
     std::unique_ptr<llvm::Module> theModule_;
-    std::map<std::string, llvm::Value *> namedValues_;
-    std::map<std::string, std::unique_ptr<PrototypeAST<CT>>> functionProtos_;
+    ScopedSymbolTable<llvm::Value *> namedValues_;
+    std::unordered_map<SymbolId, std::unique_ptr<PrototypeAST<CT>>>
+        functionProtos_;
     std::map<char, int> binoPrecedence_;
+    // batch workers only
+    std::string dataLayout_;
+    OuterProtoLookup<CT> outerProtos_;
 
     // for optimizations and JIT
-    std::unique_ptr<llvm::FunctionPassManager> theFPM_;
-    std::unique_ptr<llvm::LoopAnalysisManager> theLAM_;
-    std::unique_ptr<llvm::FunctionAnalysisManager> theFAM_;
-    std::unique_ptr<llvm::CGSCCAnalysisManager> theCGAM_;
-    std::unique_ptr<llvm::ModuleAnalysisManager> theMAM_;
-    std::unique_ptr<llvm::PassInstrumentationCallbacks> thePIC_;
-    std::unique_ptr<llvm::StandardInstrumentations> theSI_;
+    TargetMachineFactory makeTargetMachine_;
+    std::unique_ptr<OptPipeline> opt_;
+    bool optHeld_ = false;
+    bool optPending_ = false;
     std::unique_ptr<llvm::orc::KaleidoscopeJIT> theJIT_;
     //
-    llvm::PassBuilder pb_;
     llvm::ExitOnError exitOnErr_;
 
-    //
-    const bool enableOpt_;
+    // 0-3, as -O0 to -O3
+    const unsigned optLevel_;
 };
@@ -0,0 +1,72 @@
+/*
+ * File: scoped_symbol_table.h
+ * Path: /parser/scoped_symbol_table.h
+ * Module: parser
+ * Lang: C/C++
+ * Created Date: Sunday, October 18th 2026, 2:21:40 pm
+ * Author: orion
+ * Email: orion.que@outlook.com
+ * ----------------------------------------------
+    This file defines the table of named values in scope during codegen.
+ *    ____                  __  _
+     / __/__ _  _____ ___  / /_(_)__  ___ _
+    _\ \/ -_) |/ / -_) _ \/ __/ / _ \/ _ `/
+   /___/\__/|___/\__/_//_/\__/_/_//_/\_,_/
+ */
+#pragma once
+#include "interner.h"
+#include <cstddef>
+#include <vector>
+
+// Maps SymbolIds to the value currently bound to them, with nested scopes.
+//  Symbol ids are dense, so the current bindings are a plain array indexed
+//  by id; a bind() logs what it shadowed and popScope() undoes the log back
+//  to the scope's mark. lookup() is one bounds check and one load, bind()
+//  and pushScope() are O(1), popScope() is O(bindings made in the scope).
+//  Unbound is what lookup() gives for a symbol bound to nothing, nullptr
+//  for a pointer T.
+template <typename T, T Unbound = T{}> class ScopedSymbolTable {
+public:
+    T lookup(SymbolId sym) const __attribute__((always_inline)) {
+        return sym < slots_.size() ? slots_[sym] : Unbound;
+    }
+
+    // binds sym in the innermost scope, shadowing any outer binding until
+    //  that scope is popped
+    void bind(SymbolId sym, T val) {
+        if (sym >= slots_.size()) slots_.resize(sym + 1, Unbound);
+        undo_.push_back({sym, slots_[sym]});
+        slots_[sym] = val;
+    }
+
+    void pushScope() { marks_.push_back(undo_.size()); }
+
+    void popScope() {
+        unwind(marks_.back());
+        marks_.pop_back();
+    }
+
+    // unbinds everything, in time proportional to the bindings made
+    void clear() {
+        unwind(0);
+        marks_.clear();
+    }
+
+private:
+    struct Shadowed {
+        SymbolId sym;
+        T val;
+    };
+
+    void unwind(size_t mark) {
+        while (undo_.size() != mark) {
+            slots_[undo_.back().sym] = undo_.back().val;
+            undo_.pop_back();
+        }
+    }
+
+    std::vector<T> slots_;
+    std::vector<Shadowed> undo_;
+    // undo_.size() when each open scope was pushed
+    std::vector<size_t> marks_;
+};